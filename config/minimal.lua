@@ -133,6 +133,17 @@ options.display_refresh_rate = false
 -- NOTE: by default is true
 options.short_cpu_info = true
 
+-- If the CPU information should show its topology instead of the number of CPUs, e.g.
+--   when true:
+--     Intel i5 760 (4C/4T) @ 2.8Ghz
+--     AMD EPYC 7763 (2S/128C/256T) @ 2.45GHz
+--     Intel i7-12700H (6P+8E/20T) @ 4.7GHz
+--   when false:
+--     Intel i5 760 (4) @ 2.8Ghz
+--
+-- NOTE: by default is false
+options.cpu_topology = false
+
 -- If the memory should be printed as GiB instead of MiB
 --
 -- NOTE: by default is true
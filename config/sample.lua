@@ -146,6 +146,16 @@ options.show_arch = true
 -- NOTE: by default is false
 options.display_refresh_rate = false
 
+-- If identical monitors should be shown once with their count in the resolution
+-- field, e.g.
+--   when true:
+--     2x 2560x1440 @ 144Hz
+--   when false:
+--     2560x1440 @ 144Hz, 2560x1440 @ 144Hz
+--
+-- NOTE: by default is false
+options.group_monitors = false
+
 -- If the CPU information should be short or include extra information, e.g.
 --   when true:
 --     Intel i5 760 (4) @ 2.8Ghz
@@ -155,7 +165,48 @@ options.display_refresh_rate = false
 -- NOTE: by default is true
 options.short_cpu_info = true
 
+-- If the CPU information should show its topology instead of the number of CPUs, e.g.
+--   when true:
+--     Intel i5 760 (4C/4T) @ 2.8Ghz
+--     AMD EPYC 7763 (2S/128C/256T) @ 2.45GHz
+--     Intel i7-12700H (6P+8E/20T) @ 4.7GHz
+--   when false:
+--     Intel i5 760 (4) @ 2.8Ghz
+--
+-- NOTE: by default is false
+options.cpu_topology = false
+
 -- If the memory should be printed as GiB instead of MiB
 --
 -- NOTE: by default is true
 options.memory_in_gib = true
+
+-- If the X server should be queried for the WM, Resolution and Terminal fields.
+-- The display is only opened when one of these fields is enabled
+--
+-- NOTE: by default is true
+options.use_x11 = true
+
+-- If displays forwarded through SSH (localhost:N) should be queried too, they
+-- show the information of the SSH client machine
+--
+-- NOTE: by default is false
+options.x11_forwarded = false
+
+-- How long (in milliseconds) to wait for the X server to complete the connection
+-- setup, e.g. when DISPLAY points to a dead server
+--
+-- NOTE: by default is 250
+options.x11_timeout = 250
+
+-- How long (in seconds) the slow fields are cached for. A cached field is only
+-- reused while the files it was computed from are unchanged, e.g. the packages
+-- count is computed again right after installing a package. The CPU is checked
+-- against the online CPUs, the WM and Resolution against the window manager and
+-- the XRandR screen configuration. Set a field to 0 for disabling its cache.
+--
+-- Cacheable fields: os, packages, cpu, wm, resolution.
+--
+-- NOTE: by default os is cached for a week, resolution for an hour and the
+-- others for a day. Uptime and Memory are never cached
+options.cache_ttl = {}
@@ -1,6 +1,9 @@
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+#include <poll.h>
 #include <stdbool.h>
+#include <sys/types.h>
 #include <lua.h>
 #include <lualib.h>
 
@@ -29,6 +32,118 @@ typedef struct custom_logo {
     char **arr;
 } custom_ascii_logo;
 
+typedef enum field_kind {
+    FIELD_NEWLINE, // "" (empty string)
+    FIELD_USER,
+    FIELD_SEPARATOR,
+    FIELD_OS,
+    FIELD_KERNEL,
+    FIELD_UPTIME,
+    FIELD_PACKAGES,
+    FIELD_WM,
+    FIELD_RESOLUTION,
+    FIELD_SHELL,
+    FIELD_TERMINAL,
+    FIELD_CPU,
+    FIELD_MEMORY,
+    FIELD_COLORS,
+    FIELD_UNKNOWN,
+    FIELD_KINDS, // Number of field kinds, not a field
+} field_kind;
+
+/**
+ * The options of the configuration file, read once after running it
+ */
+typedef struct lcfetch_options {
+    const char *accent_color;
+    const char *ascii_distro;
+    const char *colors_icon;
+    const char *colors_style;
+    const char *delimiter;
+    const char *separator;
+    bool show_arch;
+    bool display_refresh_rate;
+    bool short_cpu_info;
+    bool cpu_topology;
+    bool memory_in_gib;
+    bool display_logo;
+    bool group_monitors;
+    bool use_x11;
+    bool x11_forwarded;
+    int gap;
+    // Milliseconds to wait for the X server when opening the display
+    int x11_timeout;
+    // Fields messages indexed by field kind, e.g. "OS"
+    const char *messages[FIELD_KINDS];
+    field_kind *enabled_fields;
+    int enabled_fields_count;
+    const char **custom_ascii_logo;
+    int custom_ascii_logo_size;
+    // Cache time to live overrides indexed by field kind, negative if not overridden
+    double cache_ttl[FIELD_KINDS];
+} lcfetch_options;
+
+extern lcfetch_options options;
+
+// A string that tracks its length and capacity, see sb_new
+typedef struct strbuf {
+    char *str;
+    size_t len;
+    size_t capacity;
+} strbuf;
+
+// A monitor shown in the resolution field, see format_monitors
+typedef struct monitor {
+    int width;
+    int height;
+    // Hz, 0 if unknown
+    int refresh_rate;
+} monitor;
+
+// A function loaded with dlopen into a table of function pointers, see load_library_symbols
+typedef struct library_symbol {
+    const char *library;
+    const char *name;
+    size_t offset;
+} library_symbol;
+
+/**
+ * Xlib and XRandR functions, they are loaded when the display is opened so the runs that do
+ * not need it never load the X libraries, see get_display
+ */
+typedef struct x11_library {
+    Status (*XInitThreads)(void);
+    Display *(*XOpenDisplay)(const char *display_name);
+    int (*XCloseDisplay)(Display *display);
+    int (*XDefaultScreen)(Display *display);
+    Atom (*XInternAtom)(Display *display, const char *atom_name, Bool only_if_exists);
+    int (*XGetWindowProperty)(Display *display, Window w, Atom property, long long_offset, long long_length,
+                              Bool delete, Atom req_type, Atom *actual_type_return, int *actual_format_return,
+                              unsigned long *nitems_return, unsigned long *bytes_after_return,
+                              unsigned char **prop_return);
+    int (*XFree)(void *data);
+    int (*XSelectInput)(Display *display, Window w, long event_mask);
+    int (*XPending)(Display *display);
+    int (*XNextEvent)(Display *display, XEvent *event_return);
+    int (*XFlush)(Display *display);
+    XRRScreenResources *(*XRRGetScreenResourcesCurrent)(Display *display, Window window);
+    void (*XRRFreeScreenResources)(XRRScreenResources *resources);
+    XRRCrtcInfo *(*XRRGetCrtcInfo)(Display *display, XRRScreenResources *resources, RRCrtc crtc);
+    void (*XRRFreeCrtcInfo)(XRRCrtcInfo *crtc_info);
+    Bool (*XRRQueryExtension)(Display *display, int *event_base_return, int *error_base_return);
+    void (*XRRSelectInput)(Display *display, Window window, int mask);
+} x11_library;
+
+extern x11_library x11;
+
+#define MAX_PACKAGE_SOURCES 2
+typedef struct package_manager {
+    const char *name;
+    int (*count)(void);
+    const char *sources[MAX_PACKAGE_SOURCES];
+    int packages;
+} package_manager;
+
 /* lcfetch.c */
 #define BUF_SIZE 256
 #define COUNT(x) (int)(sizeof x / sizeof *x)
@@ -47,10 +162,91 @@ char *get_cpu();
 char *get_memory();
 char *get_colors_dark();
 char *get_colors_bright();
+void print_info(char *distro_logo);
 
 /* memory.c */
 void *xmalloc(size_t size);
+char *xstrdup(const char *str);
 void xfree(void *ptr);
+void *arena_alloc(size_t size);
+char *arena_strdup(const char *str);
+void reset_arena(void);
+void free_arena(void);
+
+/* fields.c */
+field_kind get_field_kind(const char *name);
+const char *get_field_name(field_kind kind);
+bool enabled_fields_use_display(void);
+char **collect_fields(const field_kind *fields, int fields_count, const bool *changed);
+void refresh_warm_fields(const bool *stale, bool changed);
+void free_warm_fields(void);
+void start_speculative_collection(void);
+void finish_speculative_collection(void);
+void remember_enabled_fields(void);
+
+/* cache.c */
+bool get_cached_field(field_kind kind, char **value);
+void set_cached_field(field_kind kind, const char *value);
+void save_fields_cache(void);
+void reload_fields_cache(void);
+bool is_field_cacheable(field_kind kind);
+int get_field_source_paths(field_kind kind, char **paths, int max_paths);
+
+/* herd.c */
+int acquire_herd_lock(int timeout_ms, bool *waited);
+void release_herd_lock(int lock_fd);
+
+/* daemon.c */
+bool request_frame(const char *config_file_path, const char *distro_logo);
+void run_daemon(const char *config_file_path);
+
+/* watch.c */
+#define MAX_CHANGE_WATCH_FDS 2
+bool start_change_watch(void);
+int get_change_watch_fds(struct pollfd *fds);
+void read_changes(bool *stale);
+void stop_change_watch(void);
+void run_watch(char *distro_logo);
+
+/* instant.c */
+char *get_frame_path(const char *config_file_path, const char *distro_logo);
+void copy_frame(int fd);
+bool print_frame(const char *path);
+bool start_frame_refresh(void);
+void capture_frame(const char *path);
+void store_frame(bool print);
+
+/* frame.c */
+void frame_append(const char *str);
+void flush_frame(void);
+void free_frame(void);
+
+/* x11.c */
+bool load_library_symbols(void *table, const library_symbol *symbols, int count);
+Display *get_display(void);
+void close_display(void);
+
+/* xcb.c */
+bool load_xcb_library(void);
+char *get_xcb_wm(Display *display);
+char *get_xcb_resolution(Display *display);
+char *get_xcb_terminal(Display *display);
+
+/* procfs.c */
+bool load_pseudo_file(const char *path);
+bool load_pseudo_file_head(const char *path, size_t size);
+void prefetch_pseudo_files(const char **paths, int count);
+bool get_pseudo_file_value(const char *path, const char *key, char *value, size_t size);
+int count_pseudo_file_key(const char *path, const char *key);
+bool read_pseudo_file(const char *path, char *content, size_t size);
+void free_pseudo_files(void);
+
+/* uring.c */
+bool read_files_batch(const char **paths, char **bufs, const size_t *sizes, ssize_t *lens, int count);
+
+/* packages.c */
+package_manager *count_packages(int *managers_count);
+int get_package_sources(const char **sources, int max_sources);
 
 /* cli.c */
 void version(void);
@@ -60,15 +256,23 @@ void help(void);
 size_t utf8len(char *s);
 char *repeat_string(char *str, int times);
 void truncate_whitespaces(char *str);
-char *remove_substr(char *str, const char *sub);
-char *str_to_lower(char *str);
+strbuf sb_new(size_t capacity);
+void sb_append(strbuf *sb, const char *str);
+void sb_append_len(strbuf *sb, const char *str, size_t len);
+void sb_appendf(strbuf *sb, const char *format, ...) __attribute__((format(printf, 2, 3)));
+int sb_replace_all(strbuf *sb, const char *pattern, const char *replacement);
+char *get_cache_file_path(const char *name);
+char *get_runtime_file_path(const char *name);
 char **get_distro_logo(char *distro);
 int get_distro_logo_rows(char *distro);
 char *get_distro_accent(char *distro);
 char *get_custom_accent(char *color);
 custom_ascii_logo get_custom_logo();
 void print_colors(char *logo_part, char *next_logo_part, char *gap_logo, char *gap_info);
-void print_field(char *logo_part, char *gap, const char *delimiter, char *accent, const char *field_name);
+void print_field(char *logo_part, char *gap, const char *delimiter, char *accent, field_kind kind, char *value);
+int get_mode_refresh_rate(unsigned long dot_clock, unsigned int h_total, unsigned int v_total, bool interlace,
+                          bool double_scan);
+char *format_monitors(const monitor *monitors, int count);
 char *get_property(Display *disp, Window win, Atom xa_prop_type, char *prop_name, unsigned long *size);
 bool is_android_device();
 
@@ -76,14 +280,8 @@ bool is_android_device();
 void start_lua(const char *config_file_path);
 void stop_lua(void);
 char *get_configuration_file_path(void);
-int get_table_size(const char *table);
-bool table_contains_string(const char *table, const char *key);
-
-// Get options
 bool get_option_boolean(const char *opt);
-const char *get_option_string(const char *opt);
-lua_Number get_option_number(const char *opt);
-const char *get_subtable_string(const char *table, int index);
+void set_option_boolean(const char *opt, bool value);
 
 // Set options
 int set_table_boolean(const char *key, bool value);
@@ -92,5 +290,7 @@ int set_table_number(const char *key, lua_Number value);
 int set_table_subtable(const char *key);
 int set_subtable_string(const char *table, const char *key);
 void init_options(void);
+void load_options(void);
+void free_options(void);
 
 #endif
@@ -30,11 +30,18 @@ struct sysinfo sys_info;
 struct utsname os_uname;
 struct passwd *pw;
 
-Display *display;
-int title_length;
+/**
+ * Get the length of the user@host title, without the ANSI escapes
+ */
+static int get_title_length() {
+    char hostname[BUF_SIZE / 3];
+    gethostname(hostname, BUF_SIZE / 3);
+
+    return strlen(hostname) + strlen(pw->pw_name) + 1;
+}
 
 char *get_title(char *accent_color) {
-    char *title = xmalloc(BUF_SIZE);
+    char *title = arena_alloc(BUF_SIZE);
 
     // reduce the maximum size for the title components so we don't over-fill
     // the string
@@ -46,9 +53,6 @@ char *get_title(char *accent_color) {
     getlogin_r(username, BUF_SIZE / 3); */
     char *username = pw->pw_name;
 
-    // Calculate the length of hostname + @ + username
-    title_length = strlen(hostname) + strlen(username) + 1;
-
     // Get the accent color
     snprintf(title, BUF_SIZE, "%s%s\e[0m@%s%s\e[0m\n", accent_color, username, accent_color, hostname);
 
@@ -56,19 +60,23 @@ char *get_title(char *accent_color) {
 }
 
 char *get_separator() {
-    const char *separator = get_option_string("separator");
+    const char *separator = options.separator;
+    // Calculate the length of hostname + @ + username
+    int title_length = get_title_length();
     return repeat_string((char *)separator, title_length);
 }
 
 char *get_os(bool return_pretty_name) {
-    char *os = xmalloc(BUF_SIZE);
-    char *name = xmalloc(BUF_SIZE);
-    char *line = NULL;
-    bool show_arch = get_option_boolean("show_arch");
-    size_t len;
-
-    FILE *os_release = fopen("/etc/os-release", "r");
-    if (os_release == NULL) {
+    char *os = arena_alloc(BUF_SIZE);
+    char *name = arena_alloc(BUF_SIZE);
+    bool show_arch = options.show_arch;
+
+    // /usr/lib/os-release is the fallback when /etc/os-release does not exist
+    const char *os_release = "/etc/os-release";
+    if (!load_pseudo_file(os_release)) {
+        os_release = "/usr/lib/os-release";
+    }
+    if (!load_pseudo_file(os_release)) {
         // Android detection
         if (is_android_device()) {
             int android_version;
@@ -80,7 +88,6 @@ char *get_os(bool return_pretty_name) {
             } else {
                 snprintf(os, BUF_SIZE, "%s %d", "Android", android_version);
             }
-            xfree(name);
 
             return os;
         }
@@ -88,31 +95,28 @@ char *get_os(bool return_pretty_name) {
         log_fatal("Unable to open /etc/os-release");
         exit(1);
     }
-    while (getline(&line, &len, os_release) != -1) {
-        // NOTE: the 'NAME' field will be used later for determining the
-        // distribution ASCII logo and accent color
-        if ((!return_pretty_name) && (sscanf(line, "NAME=%s", name) > 0)) {
-            break;
-        } else if ((!return_pretty_name) && (sscanf(line, "NAME=\"%[^\"]+", name) > 0)) {
-            break;
-        } else if ((return_pretty_name) && (sscanf(line, "PRETTY_NAME=\"%[^\"]+", name) > 0)) {
-            break;
-        }
+    // NOTE: the 'NAME' field will be used later for determining the
+    // distribution ASCII logo and accent color
+    if (!get_pseudo_file_value(os_release, return_pretty_name ? "PRETTY_NAME" : "NAME", name, BUF_SIZE)) {
+        *name = '\0';
+    }
+    // The values can be quoted, e.g. NAME="Fedora Linux"
+    if (*name == '"' || *name == '\'') {
+        char quote = *name;
+        memmove(name, name + 1, strlen(name));
+        name[strcspn(name, (char[]){quote, '\0'})] = '\0';
     }
-    xfree(line);
-    fclose(os_release);
 
     if (return_pretty_name && show_arch) {
         snprintf(os, BUF_SIZE, "%s %s", name, os_uname.machine);
     } else {
         snprintf(os, BUF_SIZE, "%s", name);
     }
-    xfree(name);
 
     return os;
 }
 
-char *get_kernel() { return os_uname.release; }
+char *get_kernel() { return arena_strdup(os_uname.release); }
 
 #ifdef MACOS
 timespec get_macos_uptime() {
@@ -132,6 +136,8 @@ char *get_uptime() {
     struct timespec macos_uptime = get_macos_uptime();
     seconds = macos_uptime.tv_sec;
 #else
+    // Populate it here so it is up to date when the daemon collects it again
+    sysinfo(&sys_info);
     seconds = sys_info.uptime;
 #endif
     struct {
@@ -145,7 +151,7 @@ char *get_uptime() {
     };
 
     int n, len = 0;
-    char *uptime = xmalloc(BUF_SIZE);
+    char *uptime = arena_alloc(BUF_SIZE);
     for (int i = 0; i < 4; i++) {
         if ((n = seconds / units[i].seconds) || i == 2) {
             len += snprintf(uptime + len, BUF_SIZE - len, "%d %s%s, ", n, units[i].name, n != 1 ? "s" : "");
@@ -160,7 +166,14 @@ char *get_uptime() {
 
 char *get_wm() {
     char *wm_name = NULL;
+    Display *display = get_display();
 
+#ifdef USE_XCB
+    // The X requests are pipelined, see xcb.c
+    if (display != NULL) {
+        wm_name = get_xcb_wm(display);
+    }
+#else
     if (display != NULL) {
         Window *top_win = NULL;
 
@@ -173,66 +186,93 @@ char *get_wm() {
                 log_debug("Cannot get window manager required properties."
                           "(_NET_SUPPORTING_WM_CHECK or _WIN_SUPPORTING_WM_CHECK)\n",
                           stderr);
-                XFree(top_win);
-                return "lcfetch was not able to recognize your window manager";
+                return arena_strdup("lcfetch was not able to recognize your window manager");
             }
         }
 
-        wm_name = get_property(display, *top_win, XInternAtom(display, "UTF8_STRING", 0), "_NET_WM_NAME", NULL);
+        wm_name = get_property(display, *top_win, x11.XInternAtom(display, "UTF8_STRING", 0), "_NET_WM_NAME", NULL);
         if (!wm_name) {
             wm_name = get_property(display, *top_win, XA_STRING, "_NET_WM_NAME", NULL);
             if (!wm_name) {
                 log_debug("Cannot get name of the window manager (_NET_WM_NAME).\n");
-                xfree(wm_name);
-                return "lcfetch was not able to recognize your window manager";
+                return arena_strdup("lcfetch was not able to recognize your window manager");
             }
         }
-
-        XFree(top_win);
     }
+#endif
 
     return wm_name;
 }
 
 char *get_resolution() {
-    char *res = xmalloc(BUF_SIZE);
+    Display *display = get_display();
 
+#ifdef USE_XCB
+    if (display != NULL) {
+        return get_xcb_resolution(display);
+    }
+#else
     if (display != NULL) {
         Screen *screen = DefaultScreenOfDisplay(display);
-        bool display_refresh_rate = get_option_boolean("display_refresh_rate");
-
-        snprintf(res, BUF_SIZE, "%dx%d", screen->width, screen->height);
-        if (display_refresh_rate) {
-            Window root = RootWindow(display, 0);
-            XRRScreenConfiguration *conf = XRRGetScreenInfo(display, root);
-            snprintf(res + strlen(res), BUF_SIZE, " @ %dHz", XRRConfigCurrentRate(conf));
-            xfree(conf);
+        // The current resources are the ones cached by the server, unlike XRRGetScreenResources
+        // they do not make it probe the outputs
+        XRRScreenResources *resources = x11.XRRGetScreenResourcesCurrent(display, RootWindow(display, 0));
+        int ncrtc = resources != NULL ? resources->ncrtc : 0;
+        monitor *monitors = arena_alloc((ncrtc + 1) * sizeof(monitor));
+        int monitors_count = 0;
+
+        for (int i = 0; i < ncrtc; i++) {
+            XRRCrtcInfo *crtc = x11.XRRGetCrtcInfo(display, resources, resources->crtcs[i]);
+            if (crtc == NULL) {
+                continue;
+            }
+            // Disabled CRTCs have no mode nor outputs
+            if (crtc->mode != None && crtc->noutput > 0) {
+                monitor *mon = &monitors[monitors_count++];
+                *mon = (monitor){(int)crtc->width, (int)crtc->height, 0};
+                for (int j = 0; j < resources->nmode; j++) {
+                    XRRModeInfo *mode = &resources->modes[j];
+                    if (mode->id == crtc->mode) {
+                        mon->refresh_rate =
+                            get_mode_refresh_rate(mode->dotClock, mode->hTotal, mode->vTotal,
+                                                  mode->modeFlags & RR_Interlace, mode->modeFlags & RR_DoubleScan);
+                        break;
+                    }
+                }
+            }
+            x11.XRRFreeCrtcInfo(crtc);
         }
-    } else {
-        // If we were unable to detect the screen resolution then return NULL
-        xfree(res);
-        return NULL;
+        if (resources != NULL) {
+            x11.XRRFreeScreenResources(resources);
+        }
+
+        // Without XRandR or active CRTCs, e.g. Xvfb, fallback to the screen size
+        if (monitors_count == 0) {
+            monitors[monitors_count++] = (monitor){screen->width, screen->height, 0};
+        }
+
+        return format_monitors(monitors, monitors_count);
     }
+#endif
 
-    return res;
+    // If we were unable to detect the screen resolution then return NULL
+    return NULL;
 }
 
 char *get_shell() {
-    char *shell = xmalloc(BUF_SIZE);
+    char *shell = arena_alloc(BUF_SIZE);
     if (is_android_device() && access("/etc/shells", F_OK) != 0) {
         // Android does not have an /etc/shells file
         // so we need a special treatment for it
-        char *termux_shell = xmalloc(BUF_SIZE);
-        char *read_termux_shell = xmalloc(BUF_SIZE);
+        char termux_shell[BUF_SIZE];
+        char read_termux_shell[BUF_SIZE];
         snprintf(read_termux_shell, BUF_SIZE, "readlink %s/.termux/shell", getenv("HOME"));
 
         FILE *shell_link = popen(read_termux_shell, "r");
         fscanf(shell_link, "%s", termux_shell);
         pclose(shell_link);
-        xfree(read_termux_shell);
 
         char *shell_name = strrchr(termux_shell, '/');
-        xfree(termux_shell);
 
         // Copy only the last '/', e.g. /zsh → zsh
         strncpy(shell, shell_name + 1, BUF_SIZE);
@@ -250,7 +290,7 @@ char *get_shell() {
         // If the shell does not contains a separator in the path, e.g.
         // zsh instead of /usr/bin/zsh then write it directly
         if (shell_name == NULL) {
-            return user_shell;
+            strncpy(shell, user_shell, BUF_SIZE);
         } else {
             // Copy only the last '/', e.g. /zsh → zsh
             strncpy(shell, shell_name + 1, BUF_SIZE);
@@ -261,39 +301,47 @@ char *get_shell() {
 }
 
 char *get_terminal() {
-    unsigned char *property;
-    char *terminal = xmalloc(BUF_SIZE);
+    char *terminal = arena_alloc(BUF_SIZE);
     // Windows Terminal session, we will use it for WSL detection
     char *wt_session = getenv("WT_SESSION");
     // Get the TERM environment variable, we will use it for TTY detection
     char *environment_term = getenv("TERM");
+    Display *display = get_display();
 
     // Check if we are running in a TTY, a graphical X interface or WSL (on Windows Terminal)
     if (display != NULL) {
+#ifdef USE_XCB
+        return get_xcb_terminal(display);
+#else
+        unsigned char *property;
         // Get the current window
-        unsigned long _, window = RootWindow(display, XDefaultScreen(display));
+        unsigned long _, window = RootWindow(display, x11.XDefaultScreen(display));
         // Get the active window and the window class name
-        Atom a, active_win = XInternAtom(display, "_NET_ACTIVE_WINDOW", 1),
-                win_class = XInternAtom(display, "WM_CLASS", 1);
+        Atom a, active_win = x11.XInternAtom(display, "_NET_ACTIVE_WINDOW", 1),
+                win_class = x11.XInternAtom(display, "WM_CLASS", 1);
 
-        XGetWindowProperty(display, window, active_win, 0, 64, 0, 0, &a, (int *)&_, &_, &_, &property);
+        x11.XGetWindowProperty(display, window, active_win, 0, 64, 0, 0, &a, (int *)&_, &_, &_, &property);
         window = (property[3] << 24) + (property[2] << 16) + (property[1] << 8) + property[0];
-        xfree(property);
+        x11.XFree(property);
 
-        XGetWindowProperty(display, window, win_class, 0, 64, 0, 0, &a, (int *)&_, &_, &_, &property);
+        x11.XGetWindowProperty(display, window, win_class, 0, 64, 0, 0, &a, (int *)&_, &_, &_, &property);
 
         snprintf(terminal, BUF_SIZE, "%s", property);
-        xfree(property);
+        x11.XFree(property);
+#endif
     } else {
         // Check if we are running on WSL inside the Windows Terminal
         if (wt_session != NULL) {
             strncpy(terminal, "Windows Terminal", BUF_SIZE);
         } else {
             // In TTY, $TERM is simply returned as "linux" so we get the actual TTY name
-            if (strcmp(environment_term, "linux") == 0) {
+            if (environment_term != NULL && strcmp(environment_term, "linux") == 0 && isatty(STDIN_FILENO)) {
                 strncpy(terminal, ttyname(STDIN_FILENO), BUF_SIZE);
             } else if (is_android_device()) {
                 strncpy(terminal, "Termux", BUF_SIZE);
+            } else {
+                // If we were unable to detect the terminal then return NULL
+                return NULL;
             }
         }
     }
@@ -302,206 +350,131 @@ char *get_terminal() {
 }
 
 char *get_packages() {
-    char *pkg_managers[] = {"apt", "dnf", "rpm", "nix", "emerge", "pacman", "apk", "xbps-query", "flatpak"};
-    char *packages = xmalloc(BUF_SIZE * 2);
-    int apt, rpm, dnf, emerge, pacman, aur, nix, apk, xbps, flatpak = 0;
-
-    // Add an initial empty string to our packages characters array to be able
-    // to use snprintf() for append to it later
-    snprintf(packages, BUF_SIZE, "");
+    strbuf packages = sb_new(BUF_SIZE);
+    int managers_count;
+    package_manager *managers = count_packages(&managers_count);
 
     // Store a count of the displayed package managers so we can dynamically add the commas on them
     int displayed_pkg_managers = 0;
-    for (int i = 0; i < COUNT(pkg_managers); i++) {
-        char *pkg_manager = pkg_managers[i];
-        // Set the which command to run later
-        char *which_command = xmalloc(BUF_SIZE);
-        snprintf(which_command, BUF_SIZE, "which %s >/dev/null 2>&1", pkg_manager);
-        // If the package manager is installed
-        if (system(which_command) == 0) {
-            if (strcmp(pkg_manager, "apt") == 0) {
-                FILE *dpkg_packages = popen("dpkg --list 2> /dev/null | grep -c ^ii", "r");
-                fscanf(dpkg_packages, "%d", &apt);
-                pclose(dpkg_packages);
-                // If there are packages installed then let's print the packages count
-                // NOTE: this is for avoiding values like "0 (foo)" because you can install
-                // APT and others packages managers in almost any distro.
-                if (apt > 0) {
-                    if (displayed_pkg_managers >= 1) {
-                        snprintf(packages + strlen(packages), BUF_SIZE, ", %d (%s)", apt, "dpkg");
-                    } else {
-                        snprintf(packages + strlen(packages), BUF_SIZE, "%d (%s)", apt, "dpkg");
-                    }
-                    displayed_pkg_managers++;
-                }
-            } else if (strcmp(pkg_manager, "dnf") == 0) {
-                // Using DNF package cache is much faster than RPM
-                FILE *dnf_packages =
-                    popen("sqlite3 /var/cache/dnf/packages.db 'SELECT count(pkg) FROM installed'", "r");
-                fscanf(dnf_packages, "%d", &dnf);
-                pclose(dnf_packages);
-                if (dnf > 0) {
-                    if (displayed_pkg_managers >= 1) {
-                        snprintf(packages + strlen(packages), BUF_SIZE, ", %d (%s)", dnf, pkg_manager);
-                    } else {
-                        snprintf(packages + strlen(packages), BUF_SIZE, "%d (%s)", dnf, pkg_manager);
-                    }
-                    displayed_pkg_managers++;
-                }
-            } else if ((strcmp(pkg_manager, "rpm") == 0) && (dnf == 0)) {
-                // If the current package manager is RPM and DNF packages count is zero
-                // because if we already scanned the packages with DNF it makes no sense
-                // to scan them again
-                FILE *rpm_packages = popen("rpm -qa 2> /dev/null | wc -l", "r");
-                fscanf(rpm_packages, "%d", &rpm);
-                pclose(rpm_packages);
-                if (rpm > 0) {
-                    if (displayed_pkg_managers >= 1) {
-                        snprintf(packages + strlen(packages), BUF_SIZE, ", %d (%s)", rpm, pkg_manager);
-                    } else {
-                        snprintf(packages + strlen(packages), BUF_SIZE, "%d (%s)", rpm, pkg_manager);
-                    }
-                    displayed_pkg_managers++;
-                }
-            } else if (strcmp(pkg_manager, "emerge") == 0) {
-                FILE *emerge_packages = popen("ls -d /var/db/pkg/*/* | wc -l", "r");
-                fscanf(emerge_packages, "%d", &emerge);
-                pclose(emerge_packages);
-                if (emerge > 0) {
-                    if (displayed_pkg_managers >= 1) {
-                        snprintf(packages + strlen(packages), BUF_SIZE, ", %d (%s)", emerge, pkg_manager);
-                    } else {
-                        snprintf(packages + strlen(packages), BUF_SIZE, "%d (%s)", emerge, pkg_manager);
-                    }
-                    displayed_pkg_managers++;
-                }
-            } else if (strcmp(pkg_manager, "pacman") == 0) {
-                FILE *pacman_packages = popen("pacman -Qq 2> /dev/null | wc -l", "r");
-                fscanf(pacman_packages, "%d", &pacman);
-                pclose(pacman_packages);
-                FILE *aur_packages = popen("pacman -Qqm 2> /dev/null | wc -l", "r");
-                fscanf(aur_packages, "%d", &aur);
-                pclose(aur_packages);
-                if (pacman > 0) {
-                    if (displayed_pkg_managers >= 1) {
-                        snprintf(packages + strlen(packages), BUF_SIZE, ", %d (%s)", pacman, pkg_manager);
-                    } else {
-                        snprintf(packages + strlen(packages), BUF_SIZE, "%d (%s)", pacman, pkg_manager);
-                    }
-                    displayed_pkg_managers++;
-                }
-                if (aur > 0) {
-                    snprintf(packages + strlen(packages), BUF_SIZE, ", %d (%s)", aur, "AUR");
-                    displayed_pkg_managers++;
-                }
-            } else if (strcmp(pkg_manager, "nix") == 0) {
-                FILE *nix_current_system = popen("nix-store -q --requisites /run/current-system/sw", "r");
-                fscanf(nix_current_system, "%d", &nix);
-                pclose(nix_current_system);
-                FILE *nix_profile = popen("nix-store -q --requisites ~/.nix-profile", "r");
-                fscanf(nix_profile, "%d", &nix);
-                pclose(nix_profile);
-                if (nix > 0) {
-                    if (displayed_pkg_managers >= 1) {
-                        snprintf(packages + strlen(packages), BUF_SIZE, ", %d (%s)", nix, pkg_manager);
-                    } else {
-                        snprintf(packages + strlen(packages), BUF_SIZE, "%d (%s)", nix, pkg_manager);
-                    }
-                    displayed_pkg_managers++;
-                }
-            } else if (strcmp(pkg_manager, "apk") == 0) {
-                FILE *apk_packages = popen("apk info 2> /dev/null | wc -l", "r");
-                fscanf(apk_packages, "%d", &apk);
-                pclose(apk_packages);
-                if (apk > 0) {
-                    if (displayed_pkg_managers >= 1) {
-                        snprintf(packages + strlen(packages), BUF_SIZE, ", %d (%s)", apk, pkg_manager);
-                    } else {
-                        snprintf(packages + strlen(packages), BUF_SIZE, "%d (%s)", apk, pkg_manager);
-                    }
-                    displayed_pkg_managers++;
-                }
-            } else if (strcmp(pkg_manager, "xbps-query") == 0) {
-                FILE *xbps_packages = popen("xbps-query -l 2> /dev/null | wc -l", "r");
-                fscanf(xbps_packages, "%d", &xbps);
-                pclose(xbps_packages);
-                if (xbps > 0) {
-                    if (displayed_pkg_managers >= 1) {
-                        snprintf(packages + strlen(packages), BUF_SIZE, ", %d (%s)", xbps, pkg_manager);
-                    } else {
-                        snprintf(packages + strlen(packages), BUF_SIZE, "%d (%s)", xbps, pkg_manager);
-                    }
-                    displayed_pkg_managers++;
-                }
-            } else if (strcmp(pkg_manager, "flatpak") == 0) {
-                // NOTE: it seems that flatpak does not like to be called from a popen so it fails in
-                // a really stupid way sending a non-sense error, this is why we are not using 'flatpak list'
-                // for getting the flatpak packages at the moment
-                FILE *flatpak_packages = popen("echo \"$(( $(ls /var/lib/flatpak/app 2> /dev/null | wc -l) + $(ls "
-                                               "/var/lib/flatpak/runtime 2> /dev/null | wc -l) ))\"",
-                                               "r");
-                fscanf(flatpak_packages, "%d", &flatpak);
-                pclose(flatpak_packages);
-                if (flatpak > 0) {
-                    if (displayed_pkg_managers >= 1) {
-                        snprintf(packages + strlen(packages), BUF_SIZE, ", %d (%s)", flatpak, pkg_manager);
-                    } else {
-                        snprintf(packages + strlen(packages), BUF_SIZE, "%d (%s)", flatpak, pkg_manager);
-                    }
-                    displayed_pkg_managers++;
-                }
+    for (int i = 0; i < managers_count; i++) {
+        // If there are packages installed then let's print the packages count
+        // NOTE: this is for avoiding values like "0 (foo)" because you can install
+        // APT and others packages managers in almost any distro.
+        if (managers[i].packages > 0) {
+            if (displayed_pkg_managers >= 1) {
+                sb_appendf(&packages, ", %d (%s)", managers[i].packages, managers[i].name);
+            } else {
+                sb_appendf(&packages, "%d (%s)", managers[i].packages, managers[i].name);
             }
+            displayed_pkg_managers++;
         }
-        xfree(which_command);
     }
 
     // If the packages weren't calculated because the package manager is not supported then
     // return an error message that actually makes sense
-    if (strcmp(packages, "") == 0) {
-        strncat(packages, "lcfetch was not able to recognize your system package manager", BUF_SIZE);
+    if (packages.len == 0) {
+        sb_append(&packages, "lcfetch was not able to recognize your system package manager");
+    }
+
+    return packages.str;
+}
+
+/**
+ * Count the CPUs of a sysfs CPU list file, e.g. 0-3,8-11 has 8 CPUs. Returns 0 if it
+ * does not exist
+ */
+static int count_cpu_list(const char *path) {
+    char list[BUF_SIZE * 4];
+    int count = 0;
+
+    if (!read_pseudo_file(path, list, sizeof(list))) {
+        return 0;
+    }
+    for (char *range = list, *end; *range; range = end + 1) {
+        long first = strtol(range, &end, 10), last = first;
+        if (end == range) {
+            break;
+        }
+        if (*end == '-') {
+            last = strtol(end + 1, &end, 10);
+        }
+        count += last >= first ? last - first + 1 : 0;
+        if (*end != ',') {
+            break;
+        }
     }
 
-    return packages;
+    return count;
+}
+
+/**
+ * Describe the CPU topology from the sysfs topology of the first CPU, e.g. 8C/16T,
+ * 2S/128C/256T on a multi-socket machine or 6P+8E/20T on a hybrid one. It only reads a
+ * few small files so it takes the same time with 4 or 512 CPUs
+ */
+static void get_cpu_topology(int online_cpus, char *topology, size_t size) {
+    int present_cpus = count_cpu_list("/sys/devices/system/cpu/present");
+    int threads_per_core = count_cpu_list("/sys/devices/system/cpu/cpu0/topology/thread_siblings_list");
+    int cpus_per_package = count_cpu_list("/sys/devices/system/cpu/cpu0/topology/core_siblings_list");
+    // Hybrid CPUs (e.g. Intel Alder Lake) have a PMU for each kind of core, the first CPU is a
+    // performance one so its threads per core are the ones of the performance cores
+    int performance_cpus = count_cpu_list("/sys/devices/cpu_core/cpus");
+    int efficiency_cpus = count_cpu_list("/sys/devices/cpu_atom/cpus");
+    int len = 0;
+
+    if (threads_per_core < 1) {
+        threads_per_core = 1;
+    }
+    if (performance_cpus > 0 && efficiency_cpus > 0) {
+        len = snprintf(topology, size, "%dP+%dE/", performance_cpus / threads_per_core, efficiency_cpus);
+    } else {
+        if (cpus_per_package > 0 && online_cpus > cpus_per_package && online_cpus % cpus_per_package == 0) {
+            len = snprintf(topology, size, "%dS/", online_cpus / cpus_per_package);
+        }
+        len += snprintf(topology + len, size - len, "%dC/", online_cpus / threads_per_core);
+    }
+    // Show the offline CPUs too, e.g. 60/64T
+    if (present_cpus > online_cpus) {
+        snprintf(topology + len, size - len, "%d/%dT", online_cpus, present_cpus);
+    } else {
+        snprintf(topology + len, size - len, "%dT", online_cpus);
+    }
 }
 
 char *get_cpu() {
-    char *line = NULL;
-    char *cpu = xmalloc(BUF_SIZE);
-    char *cpu_model = xmalloc(BUF_SIZE / 2);
-    int num_cores = 0;
+    strbuf cpu = sb_new(BUF_SIZE);
+    char cpu_model[BUF_SIZE];
+    char topology[BUF_SIZE / 2];
+    char value[BUF_SIZE];
     int cpu_freq = 0;
     int prec = 3;
     double freq;
     char freq_unit[] = "GHz";
-    size_t len;
 
-    // TODO: find a way to get cpu cores and model without duplicating code
-    // CPU CORES
-    FILE *cpu_cores = fopen("/proc/cpuinfo", "r");
-    if (cpu_cores == NULL) {
+    // Count the CPUs from sysfs and read only the first processor of /proc/cpuinfo, it grows
+    // with the number of CPUs. The whole file is only read if there is no sysfs
+    int num_cores = count_cpu_list("/sys/devices/system/cpu/online");
+    bool cpuinfo_loaded =
+        num_cores > 0 ? load_pseudo_file_head("/proc/cpuinfo", BUF_SIZE * 16) : load_pseudo_file("/proc/cpuinfo");
+    if (!cpuinfo_loaded) {
         log_fatal("Unable to open /proc/cpuinfo");
         exit(1);
     }
-    while (getline(&line, &len, cpu_cores) != -1) {
-        num_cores += sscanf(line, "processor : %[^\n@]", cpu_model);
+    if (num_cores == 0) {
+        num_cores = count_pseudo_file_key("/proc/cpuinfo", "processor");
     }
-    fclose(cpu_cores);
-    xfree(line);
-
-    // CPU MODEL
-    line = NULL;
-    FILE *cpu_model_f = fopen("/proc/cpuinfo", "r");
-    if (cpu_model_f == NULL) {
-        log_fatal("Unable to open /proc/cpuinfo");
-        exit(1);
+    if (get_pseudo_file_value("/proc/cpuinfo", "model name", cpu_model, sizeof(cpu_model))) {
+        // Drop the frequency from the model name, e.g. Intel(R) Core(TM) i5 CPU 760 @ 2.80GHz
+        cpu_model[strcspn(cpu_model, "@")] = '\0';
+    } else {
+        *cpu_model = '\0';
     }
-    while (getline(&line, &len, cpu_model_f) != -1) {
-        if (sscanf(line, "model name : %[^\n@]", cpu_model) > 0) {
-            break;
-        }
+
+    if (options.cpu_topology) {
+        get_cpu_topology(num_cores, topology, sizeof(topology));
+    } else {
+        snprintf(topology, sizeof(topology), "%d", num_cores);
     }
-    fclose(cpu_model_f);
-    xfree(line);
 
     // Hijack processor name detection in Android devices
     // without permissive SELinux
@@ -511,33 +484,15 @@ char *get_cpu() {
         pclose(android_processor_prop);
     }
 
-    line = NULL;
-    FILE *cpufreq = fopen("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq", "r");
     // If /sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq file exists
     // then read the CPU frequency from it. Otherwise, fallback to /proc/cpuinfo
-    if (cpufreq) {
-        // cpuinfo_max_freq has only a line so we don't need a while loop
-        if (getline(&line, &len, cpufreq) != -1) {
-            sscanf(line, "%d", &cpu_freq);
-            // KHz / 1000 = MHz
-            cpu_freq /= 1000;
-        }
-    } else {
-        cpufreq = fopen("/proc/cpuinfo", "r");
-        if (cpufreq == NULL) {
-            log_fatal("Unable to open /proc/cpuinfo");
-            exit(1);
-        }
-        while (getline(&line, &len, cpufreq) != -1) {
-            if (sscanf(line, "cpu MHz: %lf", &freq) > 0) {
-                break;
-            }
-        }
+    if (read_pseudo_file("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq", value, BUF_SIZE)) {
+        // KHz / 1000 = MHz
+        cpu_freq = atoi(value) / 1000;
+    } else if (get_pseudo_file_value("/proc/cpuinfo", "cpu MHz", value, BUF_SIZE)) {
         // Convert frequency to integer, e.g. 1483
-        cpu_freq = (int)freq;
+        cpu_freq = (int)atof(value);
     }
-    fclose(cpufreq);
-    xfree(line);
 
     // If the cpu frequency is lower than 1000 then it makes no sense
     // to render it as GHz so we will change it to MHz
@@ -556,52 +511,48 @@ char *get_cpu() {
     }
 
     // e.g. Intel i5 760 (4) @ 2.8GHz
-    snprintf(cpu, BUF_SIZE, "%s (%d) @ %.*f%s", strlen(cpu_model) > 1 ? cpu_model : "", num_cores, prec, freq,
-             freq_unit);
-    xfree(cpu_model);
+    sb_appendf(&cpu, "%s (%s) @ %.*f%s", strlen(cpu_model) > 1 ? cpu_model : "", topology, prec, freq, freq_unit);
 
     // Remove unneeded information
-    bool return_short_cpu_info = get_option_boolean("short_cpu_info");
+    bool return_short_cpu_info = options.short_cpu_info;
     if (return_short_cpu_info) {
-        cpu = remove_substr(remove_substr(cpu, "(R)"), "Core(TM)");
+        sb_replace_all(&cpu, "(R)", "");
+        sb_replace_all(&cpu, "Core(TM)", "");
     }
-    cpu = remove_substr(cpu, "CPU");
+    sb_replace_all(&cpu, "CPU", "");
 
     // Remove the annoying whitespaces between characters in the string
-    truncate_whitespaces(cpu);
+    truncate_whitespaces(cpu.str);
 
     if (num_cores == 0) {
-        *cpu = '\0';
+        *cpu.str = '\0';
     }
 
-    return cpu;
+    return cpu.str;
 }
 
 char *get_memory() {
-    char *line = NULL;
-    char *memory = xmalloc(BUF_SIZE);
-    bool display_memory_in_gib = get_option_boolean("memory_in_gib");
+    char *memory = arena_alloc(BUF_SIZE);
+    bool display_memory_in_gib = options.memory_in_gib;
 
     int total_memory, used_memory;
-    int total, shared, memfree, buffers, cached, reclaimable;
-    size_t len;
+    int meminfo_values[6] = {0};
+    const char *meminfo_keys[6] = {"MemTotal", "Shmem", "MemFree", "Buffers", "Cached", "SReclaimable"};
+    char value[BUF_SIZE];
 
-    FILE *meminfo = fopen("/proc/meminfo", "r");
-    if (meminfo == NULL) {
+    // The memory changes all the time so read it again, the daemon and the watch mode
+    // collect it every second
+    if (!load_pseudo_file("/proc/meminfo")) {
         log_fatal("Unable to open /proc/meminfo");
         exit(1);
     }
-    while (getline(&line, &len, meminfo) != -1) {
-        /* if sscanf doesn't find a match, pointer is untouched */
-        sscanf(line, "MemTotal: %d", &total);
-        sscanf(line, "Shmem: %d", &shared);
-        sscanf(line, "MemFree: %d", &memfree);
-        sscanf(line, "Buffers: %d", &buffers);
-        sscanf(line, "Cached: %d", &cached);
-        sscanf(line, "SReclaimable: %d", &reclaimable);
+    for (int i = 0; i < COUNT(meminfo_keys); i++) {
+        if (get_pseudo_file_value("/proc/meminfo", meminfo_keys[i], value, BUF_SIZE)) {
+            meminfo_values[i] = atoi(value);
+        }
     }
-    fclose(meminfo);
-    xfree(line);
+    int total = meminfo_values[0], shared = meminfo_values[1], memfree = meminfo_values[2],
+        buffers = meminfo_values[3], cached = meminfo_values[4], reclaimable = meminfo_values[5];
 
     // we're using same calculation as neofetch
     // KiB / 1024 = MiB
@@ -620,76 +571,64 @@ char *get_memory() {
 }
 
 char *get_colors_dark() {
-    char *dark_colors = xmalloc(BUF_SIZE);
-    char *str = dark_colors;
-    const char *colors_style = get_option_string("colors_style");
-    const char *colors_icon = get_option_string("colors_icon");
+    strbuf colors = sb_new(BUF_SIZE);
+    const char *colors_style = options.colors_style;
+    const char *colors_icon = options.colors_icon;
 
     for (int i = 0; i < 8; i++) {
         if (strlen(colors_icon) > 0) {
-            int color_message_len = snprintf(NULL, 0, "\e[30m%s", colors_icon);
-            sprintf(str, "\e[3%dm%s", i, colors_icon);
-            str += color_message_len;
+            sb_appendf(&colors, "\e[3%dm%s", i, colors_icon);
         } else {
             if (strcasecmp(colors_style, "circles") == 0) {
-                sprintf(str, "\e[3%dm⬤  ", i);
-                str += 10;
+                sb_appendf(&colors, "\e[3%dm⬤  ", i);
             } else if (strcasecmp(colors_style, "ghosts") == 0) {
-                sprintf(str, "\e[3%dm   ", i);
-                str += 11;
+                sb_appendf(&colors, "\e[3%dm   ", i);
             } else if (strcasecmp(colors_style, "classic") == 0) {
-                sprintf(str, "\e[4%dm   ", i);
-                str += 8;
+                sb_appendf(&colors, "\e[4%dm   ", i);
             }
         }
     }
-    snprintf(str, 5, "\e[0m");
+    sb_append(&colors, "\e[0m");
 
-    return dark_colors;
+    return colors.str;
 }
 
 char *get_colors_bright() {
-    char *bright_colors = xmalloc(BUF_SIZE);
-    char *str = bright_colors;
-    const char *colors_style = get_option_string("colors_style");
-    const char *colors_icon = get_option_string("colors_icon");
+    strbuf colors = sb_new(BUF_SIZE);
+    const char *colors_style = options.colors_style;
+    const char *colors_icon = options.colors_icon;
 
     for (int i = 8; i < 16; i++) {
         if (strlen(colors_icon) > 0) {
-            int color_message_len = snprintf(NULL, 0, "\e[38;5;0m%s", colors_icon);
-            sprintf(str, "\e[38;5;%dm%s", i, colors_icon);
-            str += color_message_len + (i >= 10 ? 1 : 0);
+            sb_appendf(&colors, "\e[38;5;%dm%s", i, colors_icon);
         } else {
             if (strcasecmp(colors_style, "circles") == 0) {
-                sprintf(str, "\e[38;5;%dm⬤  ", i);
-                str += 14 + (i >= 10 ? 1 : 0);
+                sb_appendf(&colors, "\e[38;5;%dm⬤  ", i);
             } else if (strcasecmp(colors_style, "ghosts") == 0) {
-                sprintf(str, "\e[38;5;%dm   ", i);
-                str += 15 + (i >= 10 ? 1 : 0);
+                sb_appendf(&colors, "\e[38;5;%dm   ", i);
             } else if (strcasecmp(colors_style, "classic") == 0) {
-                sprintf(str, "\e[48;5;%dm   ", i);
-                str += 12 + (i >= 10 ? 1 : 0);
+                sb_appendf(&colors, "\e[48;5;%dm   ", i);
             }
         }
     }
-    snprintf(str, 5, "\e[0m");
+    sb_append(&colors, "\e[0m");
 
-    return bright_colors;
+    return colors.str;
 }
 
 void print_info(char *distro_logo) {
     // If the ASCII distro logo should be printed
-    bool display_logo = get_option_boolean("display_logo");
+    bool display_logo = options.display_logo;
     // The delimiter shown between the field message and the information, e.g.
     // OS: Fedora 34 (KDE Plasma) x86_64
     //   ^
     // delimiter
-    const char *delimiter = get_option_string("delimiter");
+    const char *delimiter = options.delimiter;
 
     // Get the accent color and logo for the current distro
     char *current_distro = get_os(0);
-    const char *custom_distro_logo = get_option_string("ascii_distro");
-    const char *custom_accent_color = get_option_string("accent_color");
+    const char *custom_distro_logo = options.ascii_distro;
+    const char *custom_accent_color = options.accent_color;
     // Compare the current distribution first so we can override the information later
     // with the custom ascii distro logo
     char **logo = get_distro_logo(current_distro);
@@ -698,37 +637,35 @@ void print_info(char *distro_logo) {
     if (strlen(custom_distro_logo) > 0) {
         logo = get_distro_logo((char *)custom_distro_logo);
         logo_rows = get_distro_logo_rows((char *)custom_distro_logo);
-        xfree(accent_color);
         accent_color = get_distro_accent((char *)custom_distro_logo);
     }
     if (distro_logo != NULL) {
         logo = get_distro_logo(distro_logo);
         logo_rows = get_distro_logo_rows(distro_logo);
-        xfree(accent_color);
         accent_color = get_distro_accent(distro_logo);
     }
     if (strlen(custom_accent_color) > 0) {
-        xfree(accent_color);
         accent_color = get_custom_accent((char *)custom_accent_color);
     }
-    xfree(current_distro);
 
     bool is_custom_logo = false;
     struct custom_logo custom_ascii_logo = get_custom_logo();
     if (custom_ascii_logo.cols > 0 && distro_logo == NULL) {
-        memmove(logo, custom_ascii_logo.arr, BUF_SIZE);
+        logo = custom_ascii_logo.arr;
         logo_rows = custom_ascii_logo.cols;
         is_custom_logo = true;
-        xfree(custom_ascii_logo.arr);
     }
 
-    // Get the amount of enabled information fields
-    int enabled_fields = get_table_size("enabled_fields");
+    // Get the enabled information fields and collect all of them before rendering
+    int enabled_fields = options.enabled_fields_count;
+    const field_kind *fields = options.enabled_fields;
+    char **values = collect_fields(fields, enabled_fields, NULL);
+
     if (display_logo) {
         // Get the logo length, substracting the ANSI escapes length
         int logo_length = is_custom_logo ? custom_ascii_logo.rows : (utf8len(logo[0]) - strlen("\e[1;00m"));
         // Get the gap that should be between the logo and the information
-        int gap_size = get_option_number("gap");
+        int gap_size = options.gap;
         char *gap_logo_info = repeat_string(" ", gap_size);
         // This gap is specially used when there's more information but the
         // logo is already complete
@@ -742,19 +679,22 @@ void print_info(char *distro_logo) {
             if (i >= enabled_fields) {
                 // If we've run out of information to show then we will
                 // just print the next logo line
-                printf("%s%s%s\n", accent_color, logo[i], "\e[0m");
+                frame_append(accent_color);
+                frame_append(logo[i]);
+                frame_append("\e[0m\n");
             } else {
                 displayed_info++;
 
-                const char *field = get_subtable_string("enabled_fields", i + 1);
-                if (strcasecmp(field, "Colors") == 0) {
+                field_kind field = fields[i];
+                if (field == FIELD_COLORS) {
                     print_colors(logo[i], (i + 1 >= logo_rows) ? "" : logo[i + 1], gap_logo, gap_logo_info);
                     i++;
-                } else if (strcmp(field, "") == 0) {
+                } else if (field == FIELD_NEWLINE) {
                     // If we should draw an empty line as a separator
-                    printf("%s%s\n", logo[i], "\e[0m");
+                    frame_append(logo[i]);
+                    frame_append("\e[0m\n");
                 } else {
-                    print_field(logo[i], gap_logo_info, delimiter, accent_color, field);
+                    print_field(logo[i], gap_logo_info, delimiter, accent_color, field, values[field]);
                 }
             }
         }
@@ -762,49 +702,38 @@ void print_info(char *distro_logo) {
         // leaving a padding from the logo
         if (displayed_info < enabled_fields + 2) {
             for (int i = displayed_info + 1; i <= enabled_fields; i++) {
-                const char *field = get_subtable_string("enabled_fields", i);
-                if (strcasecmp(field, "colors") == 0) {
+                field_kind field = fields[i - 1];
+                if (field == FIELD_COLORS) {
                     print_colors("", "", gap_logo, gap_logo_info);
-                } else if (strcmp(field, "") == 0) {
+                } else if (field == FIELD_NEWLINE) {
                     // If we should draw an empty line as a separator
-                    printf("%s\n", gap_logo);
+                    frame_append(gap_logo);
+                    frame_append("\n");
                 } else {
-                    print_field(gap_logo, gap_logo_info, delimiter, accent_color, field);
+                    print_field(gap_logo, gap_logo_info, delimiter, accent_color, field, values[field]);
                 }
             }
         }
-
-        // If the gap between the logo and the information was higher than 0
-        // then we will need to free it
-        if (gap_size >= 1) {
-            xfree(gap_logo_info);
-        }
-        xfree(gap_logo);
     } else {
         // Get the gap that should be between the left terminal border and the information
-        int gap_size = get_option_number("gap");
-        char *gap_term_info = repeat_string(" ", gap_size);
-
+        int gap_size = options.gap;
         // Do not add gaps if gap_size is 0
-        if (gap_size == 0) {
-            gap_term_info = "";
-        }
+        char *gap_term_info = gap_size > 0 ? repeat_string(" ", gap_size) : "";
 
         for (int i = 1; i <= enabled_fields; i++) {
-            const char *field = get_subtable_string("enabled_fields", i);
-            if (strcasecmp(field, "colors") == 0) {
+            field_kind field = fields[i - 1];
+            if (field == FIELD_COLORS) {
                 print_colors("", "", gap_term_info, "");
             } else {
                 // If we should draw an empty line as a separator
-                if (strcmp(field, "") == 0) {
-                    printf("\n");
+                if (field == FIELD_NEWLINE) {
+                    frame_append("\n");
                 } else {
-                    print_field(NULL, gap_term_info, delimiter, accent_color, field);
+                    print_field(NULL, gap_term_info, delimiter, accent_color, field, values[field]);
                 }
             }
         }
     }
-    xfree(accent_color);
 }
 
 int main(int argc, char *argv[]) {
@@ -812,16 +741,23 @@ int main(int argc, char *argv[]) {
     int c;
     char *distro_logo = NULL;
     char *config_file_path = NULL;
+    bool instant = false;
+    bool daemon_mode = false;
+    bool watch_mode = false;
     while (1) {
         static struct option long_options[] = {
             {"help", no_argument, NULL, 'h'},
             {"version", no_argument, NULL, 'v'},
             {"config", required_argument, NULL, 'c'},
             {"distro_name", required_argument, NULL, 'd'},
+            {"instant", no_argument, NULL, 'i'},
+            {"daemon", no_argument, NULL, 'D'},
+            {"watch", no_argument, NULL, 'w'},
+            {NULL, 0, NULL, 0},
         };
 
         int option_index = 0;
-        c = getopt_long(argc, argv, "hvcd:", long_options, &option_index);
+        c = getopt_long(argc, argv, "hvc:d:iDw", long_options, &option_index);
 
         // Detect the end of the command-line options
         if (c == -1) {
@@ -840,43 +776,86 @@ int main(int argc, char *argv[]) {
         case 'd':
             distro_logo = optarg;
             break;
+        case 'i':
+            instant = true;
+            break;
+        case 'D':
+            daemon_mode = true;
+            break;
+        case 'w':
+            watch_mode = true;
+            break;
         default:
             help();
             exit(1);
         }
     }
 
-    // Start our Lua environment
-    start_lua(config_file_path);
+    // Let the daemon render the frame if it is running, it already has every field collected
+    if (!daemon_mode && !watch_mode && request_frame(config_file_path, distro_logo)) {
+        return 0;
+    }
+
+    // Print the last rendered frame right away and render a new one in the background
+    // for the next run
+    char *frame_path = instant && !daemon_mode && !watch_mode ? get_frame_path(config_file_path, distro_logo) : NULL;
+    bool frame_printed = false;
+    if (frame_path != NULL) {
+        frame_printed = print_frame(frame_path);
+        if (frame_printed && !start_frame_refresh()) {
+            xfree(frame_path);
+            return 0;
+        }
+        capture_frame(frame_path);
+    }
 
     // populate the os_uname struct
     uname(&os_uname);
 
-#ifndef MACOS
-    // populate the sys_info struct
-    sysinfo(&sys_info);
-#endif
-
     // Get User ID
     const uid_t uid = getuid();
 
     // populate the passwd struct
     pw = getpwuid(uid);
 
-    display = XOpenDisplay(NULL);
+    // Start our Lua environment
+    start_lua(config_file_path);
+
+    if (daemon_mode || watch_mode) {
+        if (daemon_mode) {
+            run_daemon(config_file_path);
+        } else {
+            run_watch(distro_logo);
+        }
+        close_display();
+        free_frame();
+        free_arena();
+        stop_lua();
+        return 0;
+    }
 
     // Disable line wrapping so we can keep the logo intact on small terminals
-    printf("\e[?7l");
-    // Print all stuff (logo, information)
+    frame_append("\e[?7l");
+    // Render all stuff (logo, information)
     print_info(distro_logo);
     // Re-enable line wrapping again
-    printf("\e[?7h");
+    frame_append("\e[?7h");
+    // Print the whole frame at once
+    flush_frame();
 
-    if (display != NULL) {
-        XCloseDisplay(display);
+    if (frame_path != NULL) {
+        // If there was no cached frame yet then nothing was printed so far
+        store_frame(!frame_printed);
+        xfree(frame_path);
     }
 
+    // The X display is only opened if an enabled field needed it
+    close_display();
+
     // Close our Lua environment and release resources
+    free_frame();
+    free_arena();
+    free_pseudo_files();
     stop_lua();
     return 0;
 }
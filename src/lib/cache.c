@@ -0,0 +1,512 @@
+/* C stdlib */
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+/* Custom headers */
+#include "lcfetch.h"
+
+#define FIELDS_CACHE_NAME "fields"
+#define MAX_FIELD_SOURCES 3
+#define SIGNATURE_SIZE (BUF_SIZE * 8)
+// Fields without a value (e.g. no X display) are cached for a short time only, long enough for
+// the instances started at the same time but a failed collection is not kept for the whole TTL
+#define NO_VALUE_TTL 60
+// Stored in place of the value of a field that has none, the values backslashes are escaped
+#define NO_VALUE "\\N"
+
+// Special sources that are not a single file
+#define SOURCE_BOOT_ID "@boot_id"
+#define SOURCE_PACKAGES "@packages"
+#define SOURCE_ONLINE_CPUS "@online_cpus"
+#define SOURCE_X_SERVER "@x_server"
+#define SOURCE_X_WM "@x_wm"
+#define SOURCE_X_SCREEN "@x_screen"
+
+/**
+ * Fields that are worth caching, with their default time to live (in seconds), the sources
+ * they are computed from and the options that change their value. Volatile fields like the
+ * uptime or memory and the ones that are cheap to collect are never cached
+ */
+static const struct {
+    lua_Number default_ttl;
+    const char *sources[MAX_FIELD_SOURCES];
+    const char *options[MAX_FIELD_SOURCES];
+} cacheable_fields[FIELD_KINDS] = {
+    [FIELD_OS] = {60 * 60 * 24 * 7, {"/etc/os-release", "/usr/lib/os-release"}, {"show_arch"}},
+    [FIELD_PACKAGES] = {60 * 60 * 24, {SOURCE_PACKAGES}, {NULL}},
+    [FIELD_CPU] = {60 * 60 * 24, {SOURCE_BOOT_ID, SOURCE_ONLINE_CPUS}, {"short_cpu_info", "cpu_topology"}},
+    [FIELD_WM] = {60 * 60 * 24, {SOURCE_BOOT_ID, SOURCE_X_SERVER, SOURCE_X_WM}, {"use_x11"}},
+    [FIELD_RESOLUTION] = {60 * 60,
+                          {SOURCE_BOOT_ID, SOURCE_X_SERVER, SOURCE_X_SCREEN},
+                          {"display_refresh_rate", "group_monitors", "use_x11"}},
+};
+
+typedef struct cached_field {
+    bool present;
+    long long stored_at;
+    char *signature;
+    // NULL if the field has no value
+    char *value;
+} cached_field;
+
+static cached_field cache[FIELD_KINDS];
+// Signatures of the fields sources in the current run
+static char *current_signatures[FIELD_KINDS];
+static bool cache_loaded = false;
+static bool cache_dirty = false;
+
+/**
+ * Expand the paths relative to the user home directory, e.g. ~/.nix-profile
+ */
+static const char *expand_source_path(const char *path, char expanded_path[BUF_SIZE * 2]) {
+    if (strncmp(path, "~/", 2) != 0) {
+        return path;
+    }
+    const char *home = getenv("HOME");
+    snprintf(expanded_path, BUF_SIZE * 2, "%s%s", home != NULL ? home : "", path + 1);
+
+    return expanded_path;
+}
+
+/**
+ * Append to a signature of the given length and return the new length. Once the signature is
+ * full nothing is appended anymore and SIGNATURE_SIZE is returned, so the field is not cached
+ */
+static size_t __attribute__((format(printf, 3, 4)))
+append_signature(char *signature, size_t len, const char *format, ...) {
+    if (len >= SIGNATURE_SIZE) {
+        return SIGNATURE_SIZE;
+    }
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(signature + len, SIGNATURE_SIZE - len, format, args);
+    va_end(args);
+    if (written < 0 || (size_t)written >= SIGNATURE_SIZE - len) {
+        return SIGNATURE_SIZE;
+    }
+
+    return len + written;
+}
+
+/**
+ * Append the signature of a file (inode, modification time and size) to the given signature
+ */
+static size_t sign_file(char *signature, size_t len, const char *path) {
+    char expanded_path[BUF_SIZE * 2];
+    struct stat st;
+
+    path = expand_source_path(path, expanded_path);
+    if (stat(path, &st) != 0) {
+        return append_signature(signature, len, "%s:-;", path);
+    }
+    return append_signature(signature, len, "%s:%llu:%lld.%09ld:%lld;", path, (unsigned long long)st.st_ino,
+                            (long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec, (long long)st.st_size);
+}
+
+/**
+ * Append the current boot ID, so the signature changes after a reboot
+ */
+static size_t sign_boot_id(char *signature, size_t len) {
+    char boot_id[64] = "";
+
+    read_pseudo_file("/proc/sys/kernel/random/boot_id", boot_id, sizeof(boot_id));
+
+    return append_signature(signature, len, "boot:%s;", boot_id);
+}
+
+/**
+ * Append the CPUs that are online, they change when a CPU is hotplugged or taken offline
+ */
+static size_t sign_online_cpus(char *signature, size_t len) {
+    char online_cpus[BUF_SIZE] = "";
+
+    read_pseudo_file("/sys/devices/system/cpu/online", online_cpus, sizeof(online_cpus));
+
+    return append_signature(signature, len, "cpus:%s;", online_cpus);
+}
+
+/**
+ * Append the X display in use. Local X servers create their socket when starting so
+ * the signature changes on every new X session
+ */
+static size_t sign_x_server(char *signature, size_t len) {
+    const char *x_display = getenv("DISPLAY");
+    char socket_path[BUF_SIZE];
+
+    if (x_display == NULL) {
+        return append_signature(signature, len, "display:-;");
+    }
+    len = append_signature(signature, len, "display:%s;", x_display);
+    if (*x_display == ':') {
+        snprintf(socket_path, BUF_SIZE, "/tmp/.X11-unix/X%d", atoi(x_display + 1));
+        len = sign_file(signature, len, socket_path);
+    }
+
+    return len;
+}
+
+/**
+ * Append the window the window manager announces itself with on the root window, starting a
+ * window manager (or restarting the same one) creates a new window
+ */
+static size_t sign_x_wm(char *signature, size_t len) {
+    static const char *wm_check_properties[] = {"_NET_SUPPORTING_WM_CHECK", "_WIN_SUPPORTING_WM_CHECK"};
+    Display *display = get_display();
+
+    for (int i = 0; display != NULL && i < COUNT(wm_check_properties); i++) {
+        Atom property = x11.XInternAtom(display, wm_check_properties[i], True);
+        Atom type;
+        int format;
+        unsigned long items, bytes_after;
+        unsigned char *data = NULL;
+        if (property == None ||
+            x11.XGetWindowProperty(display, DefaultRootWindow(display), property, 0, 1, False, AnyPropertyType,
+                                   &type, &format, &items, &bytes_after, &data) != Success) {
+            continue;
+        }
+        if (data != NULL && format == 32 && items == 1) {
+            // Xlib returns the 32 bits items as longs
+            unsigned long window = *(unsigned long *)data;
+            x11.XFree(data);
+            return append_signature(signature, len, "wm:%s=%lu;", wm_check_properties[i], window);
+        }
+        if (data != NULL) {
+            x11.XFree(data);
+        }
+    }
+
+    return append_signature(signature, len, "wm:-;");
+}
+
+/**
+ * Append the screen size and the XRandR configuration timestamps, the server updates them
+ * when a monitor is plugged or its mode changes. These are the screen resources cached by
+ * the server, so reading them does not make it probe the outputs
+ */
+static size_t sign_x_screen(char *signature, size_t len) {
+    Display *display = get_display();
+    if (display == NULL) {
+        return append_signature(signature, len, "screen:-;");
+    }
+
+    Screen *screen = DefaultScreenOfDisplay(display);
+    len = append_signature(signature, len, "screen:%dx%d", screen->width, screen->height);
+    XRRScreenResources *resources = x11.XRRGetScreenResourcesCurrent(display, RootWindow(display, 0));
+    if (resources != NULL) {
+        len = append_signature(signature, len, ":%lu:%lu", (unsigned long)resources->timestamp,
+                               (unsigned long)resources->configTimestamp);
+        x11.XRRFreeScreenResources(resources);
+    }
+
+    return append_signature(signature, len, ";");
+}
+
+/**
+ * Compute the signature of a field sources and options
+ */
+static char *get_field_signature(field_kind kind) {
+    char *signature = xmalloc(SIGNATURE_SIZE);
+    size_t len = 0;
+    *signature = '\0';
+
+    for (int i = 0; i < MAX_FIELD_SOURCES && cacheable_fields[kind].sources[i] != NULL; i++) {
+        const char *source = cacheable_fields[kind].sources[i];
+        if (strcmp(source, SOURCE_BOOT_ID) == 0) {
+            len = sign_boot_id(signature, len);
+        } else if (strcmp(source, SOURCE_ONLINE_CPUS) == 0) {
+            len = sign_online_cpus(signature, len);
+        } else if (strcmp(source, SOURCE_X_SERVER) == 0) {
+            len = sign_x_server(signature, len);
+        } else if (strcmp(source, SOURCE_X_WM) == 0) {
+            len = sign_x_wm(signature, len);
+        } else if (strcmp(source, SOURCE_X_SCREEN) == 0) {
+            len = sign_x_screen(signature, len);
+        } else if (strcmp(source, SOURCE_PACKAGES) == 0) {
+            const char *package_sources[32];
+            int package_sources_count = get_package_sources(package_sources, COUNT(package_sources));
+            for (int j = 0; j < package_sources_count && len < SIGNATURE_SIZE; j++) {
+                len = sign_file(signature, len, package_sources[j]);
+            }
+        } else {
+            len = sign_file(signature, len, source);
+        }
+        if (len >= SIGNATURE_SIZE) {
+            xfree(signature);
+            return NULL;
+        }
+    }
+    for (int i = 0; i < MAX_FIELD_SOURCES && cacheable_fields[kind].options[i] != NULL; i++) {
+        const char *option = cacheable_fields[kind].options[i];
+        len = append_signature(signature, len, "%s=%d;", option, get_option_boolean(option));
+    }
+    // Separators are used by the cache file format
+    if (len >= SIGNATURE_SIZE || strpbrk(signature, "\t\n") != NULL) {
+        xfree(signature);
+        return NULL;
+    }
+
+    return signature;
+}
+
+/**
+ * Get the files and directories a field is computed from, so they can be watched for changes.
+ * Returns the number of paths, every one of them must be freed by the caller
+ */
+int get_field_source_paths(field_kind kind, char **paths, int max_paths) {
+    char expanded_path[BUF_SIZE * 2];
+    const char *sources[32];
+    int sources_count = 0;
+    int paths_count = 0;
+
+    for (int i = 0; i < MAX_FIELD_SOURCES && cacheable_fields[kind].sources[i] != NULL; i++) {
+        const char *source = cacheable_fields[kind].sources[i];
+        if (strcmp(source, SOURCE_PACKAGES) == 0) {
+            sources_count += get_package_sources(sources + sources_count, COUNT(sources) - sources_count);
+        } else if (*source != '@' && sources_count < COUNT(sources)) {
+            sources[sources_count++] = source;
+        }
+    }
+    for (int i = 0; i < sources_count && paths_count < max_paths; i++) {
+        paths[paths_count++] = xstrdup(expand_source_path(sources[i], expanded_path));
+    }
+
+    return paths_count;
+}
+
+/**
+ * Get the time to live of a cached field, it can be overridden in the 'cache_ttl' options table
+ */
+static lua_Number get_field_ttl(field_kind kind) {
+    if (cacheable_fields[kind].default_ttl <= 0) {
+        return 0;
+    }
+    return options.cache_ttl[kind] >= 0 ? options.cache_ttl[kind] : cacheable_fields[kind].default_ttl;
+}
+
+/**
+ * Check if a field can be cached at all, i.e. its time to live was not set to 0 and its
+ * sources can be signed
+ */
+bool is_field_cacheable(field_kind kind) {
+    if (get_field_ttl(kind) <= 0) {
+        return false;
+    }
+    if (current_signatures[kind] == NULL) {
+        current_signatures[kind] = get_field_signature(kind);
+    }
+
+    return current_signatures[kind] != NULL;
+}
+
+/**
+ * Release a cached field
+ */
+static void forget_cached_field(field_kind kind) {
+    if (cache[kind].present) {
+        xfree(cache[kind].signature);
+        if (cache[kind].value != NULL) {
+            xfree(cache[kind].value);
+        }
+        cache[kind].present = false;
+    }
+}
+
+/**
+ * Write a value escaping the backslashes, tabs and newlines used by the cache file format
+ */
+static void write_escaped_value(FILE *cache_file, const char *value) {
+    for (const char *c = value; *c != '\0'; c++) {
+        if (*c == '\\') {
+            fputs("\\\\", cache_file);
+        } else if (*c == '\t') {
+            fputs("\\t", cache_file);
+        } else if (*c == '\n') {
+            fputs("\\n", cache_file);
+        } else {
+            fputc(*c, cache_file);
+        }
+    }
+}
+
+/**
+ * Undo write_escaped_value in place
+ */
+static void unescape_value(char *value) {
+    char *out = value;
+    for (const char *c = value; *c != '\0'; c++) {
+        if (*c == '\\' && (c[1] == '\\' || c[1] == 't' || c[1] == 'n')) {
+            c++;
+            *out++ = *c == 't' ? '\t' : *c == 'n' ? '\n' : '\\';
+        } else {
+            *out++ = *c;
+        }
+    }
+    *out = '\0';
+}
+
+/**
+ * Load the cached fields, every line is: <field name> TAB <timestamp> TAB <signature> TAB <value>
+ * where the value is escaped, or NO_VALUE if the field has none
+ */
+static void load_fields_cache(void) {
+    char *line = NULL;
+    size_t len;
+
+    cache_loaded = true;
+    char *cache_path = get_cache_file_path(FIELDS_CACHE_NAME);
+    if (cache_path == NULL) {
+        return;
+    }
+    FILE *cache_file = fopen(cache_path, "r");
+    xfree(cache_path);
+    if (cache_file == NULL) {
+        return;
+    }
+
+    while (getline(&line, &len, cache_file) != -1) {
+        line[strcspn(line, "\n")] = '\0';
+        char *stored_at = strchr(line, '\t');
+        char *signature = stored_at != NULL ? strchr(stored_at + 1, '\t') : NULL;
+        char *value = signature != NULL ? strchr(signature + 1, '\t') : NULL;
+        if (value == NULL) {
+            continue;
+        }
+        *stored_at++ = *signature++ = *value++ = '\0';
+
+        field_kind kind = get_field_kind(line);
+        if (kind == FIELD_UNKNOWN || cacheable_fields[kind].default_ttl <= 0 || cache[kind].present) {
+            continue;
+        }
+        cache[kind].present = true;
+        cache[kind].stored_at = strtoll(stored_at, NULL, 10);
+        cache[kind].signature = xstrdup(signature);
+        if (strcmp(value, NO_VALUE) == 0) {
+            cache[kind].value = NULL;
+        } else {
+            unescape_value(value);
+            cache[kind].value = xstrdup(value);
+        }
+    }
+    if (line != NULL) {
+        xfree(line);
+    }
+    fclose(cache_file);
+}
+
+/**
+ * Get the cached value of a field if its sources did not change since it was stored
+ * and it has not expired yet. The returned value is allocated in the arena, or NULL if
+ * the field had no value
+ */
+bool get_cached_field(field_kind kind, char **value) {
+    lua_Number ttl = get_field_ttl(kind);
+    if (ttl <= 0) {
+        return false;
+    }
+
+    if (!cache_loaded) {
+        load_fields_cache();
+    }
+    if (current_signatures[kind] == NULL) {
+        current_signatures[kind] = get_field_signature(kind);
+    }
+    if (!cache[kind].present || current_signatures[kind] == NULL) {
+        return false;
+    }
+
+    if (cache[kind].value == NULL && ttl > NO_VALUE_TTL) {
+        ttl = NO_VALUE_TTL;
+    }
+    long long age = (long long)time(NULL) - cache[kind].stored_at;
+    if (age < 0 || age >= ttl || strcmp(cache[kind].signature, current_signatures[kind]) != 0) {
+        return false;
+    }
+    *value = cache[kind].value != NULL ? arena_strdup(cache[kind].value) : NULL;
+
+    return true;
+}
+
+/**
+ * Store the value of a field in the cache (NULL if it has none), it will be written by
+ * save_fields_cache
+ */
+void set_cached_field(field_kind kind, const char *value) {
+    if (get_field_ttl(kind) <= 0) {
+        return;
+    }
+
+    if (!cache_loaded) {
+        load_fields_cache();
+    }
+    if (current_signatures[kind] == NULL) {
+        current_signatures[kind] = get_field_signature(kind);
+        if (current_signatures[kind] == NULL) {
+            return;
+        }
+    }
+
+    forget_cached_field(kind);
+    cache[kind].present = true;
+    cache[kind].stored_at = time(NULL);
+    cache[kind].signature = xstrdup(current_signatures[kind]);
+    cache[kind].value = value != NULL ? xstrdup(value) : NULL;
+    cache_dirty = true;
+}
+
+/**
+ * Drop the loaded cache so it is read again from disk, e.g. after another instance updated it.
+ * Pending changes are lost so this must be called before set_cached_field
+ */
+void reload_fields_cache(void) {
+    for (int kind = 0; kind < FIELD_KINDS; kind++) {
+        forget_cached_field(kind);
+    }
+    cache_loaded = cache_dirty = false;
+}
+
+/**
+ * Write the cached fields to disk if they have changed and release them
+ */
+void save_fields_cache(void) {
+    char *cache_path = cache_dirty ? get_cache_file_path(FIELDS_CACHE_NAME) : NULL;
+    if (cache_path != NULL) {
+        char *tmp_path = xmalloc(strlen(cache_path) + 16);
+        sprintf(tmp_path, "%s.%d", cache_path, (int)getpid());
+
+        // Write it in a temporary file first so concurrent runs never read an incomplete cache
+        FILE *cache_file = fopen(tmp_path, "w");
+        if (cache_file != NULL) {
+            for (int kind = 0; kind < FIELD_KINDS; kind++) {
+                if (cache[kind].present) {
+                    fprintf(cache_file, "%s\t%lld\t%s\t", get_field_name(kind), cache[kind].stored_at,
+                            cache[kind].signature);
+                    if (cache[kind].value != NULL) {
+                        write_escaped_value(cache_file, cache[kind].value);
+                    } else {
+                        fputs(NO_VALUE, cache_file);
+                    }
+                    fputc('\n', cache_file);
+                }
+            }
+            if (fclose(cache_file) != 0 || rename(tmp_path, cache_path) != 0) {
+                unlink(tmp_path);
+            }
+        }
+        xfree(tmp_path);
+        xfree(cache_path);
+    }
+
+    for (int kind = 0; kind < FIELD_KINDS; kind++) {
+        forget_cached_field(kind);
+        if (current_signatures[kind] != NULL) {
+            xfree(current_signatures[kind]);
+            current_signatures[kind] = NULL;
+        }
+    }
+    cache_loaded = cache_dirty = false;
+}
@@ -13,6 +13,9 @@ void help() {
                                "\t-c, --config /path/to/config\tSpecify a path to a custom config "
                                "file\n"
                                "\t-d, --distro_name distro_name\tDistribution logo\n"
+                               "\t-i, --instant\t\t\t\t\tPrint the last output and refresh it in the background\n"
+                               "\t-D, --daemon\t\t\t\t\tKeep running in the background and serve the next runs\n"
+                               "\t-w, --watch\t\t\t\t\t\tKeep the information on the screen and update it live\n"
                                "\t-h, --help\t\t\t\t\t\tPrint this message and exit\n"
                                "\t-v, --version\t\t\t\t\tShow lcfetch version\n\n"
                                "Report bugs to https://github.com/NTBBloodbath/lcfetch/issues\n";
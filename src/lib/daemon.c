@@ -0,0 +1,431 @@
+/* C stdlib */
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+/* Custom headers */
+#include "lcfetch.h"
+#include <log.h>
+
+#define DAEMON_SOCKET_NAME "lcfetch.sock"
+// How often the daemon collects the uptime and memory again, so they are never older than this
+#define DAEMON_REFRESH_INTERVAL_MS 1000
+// Maximum time a client waits for the daemon, and the daemon for a client request
+#define DAEMON_TIMEOUT_MS 2000
+#define REQUEST_SIZE (BUF_SIZE * 16)
+
+// Daemon replies
+#define DAEMON_RENDERED 'R'
+#define DAEMON_REFUSED 'X'
+
+// Environment variables of the client that change the per-client fields
+static const char *client_environment[] = {"SHELL", "TERM", "WT_SESSION"};
+
+static volatile sig_atomic_t daemon_running = true;
+
+static void stop_daemon(int signum __attribute__((unused))) { daemon_running = false; }
+
+/**
+ * Fill the address of the daemon socket, returns false if there is no runtime directory
+ * or its path is too long for a socket
+ */
+static bool get_daemon_address(struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+
+    char *socket_path = get_runtime_file_path(DAEMON_SOCKET_NAME);
+    if (socket_path == NULL) {
+        return false;
+    }
+    bool fits = strlen(socket_path) < sizeof(address->sun_path);
+    if (fits) {
+        strcpy(address->sun_path, socket_path);
+    }
+    xfree(socket_path);
+
+    return fits;
+}
+
+/**
+ * Get the absolute path of the configuration file in use, or an empty string for the
+ * default one, so the client and the daemon can tell whether they share the same one
+ */
+static void get_config_identity(const char *config_file_path, char *identity) {
+    *identity = '\0';
+    if (config_file_path != NULL && realpath(config_file_path, identity) == NULL) {
+        snprintf(identity, PATH_MAX, "%s", config_file_path);
+    }
+}
+
+/**
+ * Append a 'key=value' line to a request, returns false if it does not fit or the
+ * value can not be sent
+ */
+static bool append_request_entry(char *request, size_t *len, const char *key, const char *value) {
+    if (value == NULL) {
+        value = "";
+    }
+    if (strchr(value, '\n') != NULL) {
+        return false;
+    }
+    int written = snprintf(request + *len, REQUEST_SIZE - *len, "%s=%s\n", key, value);
+    if (written < 0 || (size_t)written >= REQUEST_SIZE - *len) {
+        return false;
+    }
+    *len += written;
+
+    return true;
+}
+
+/**
+ * Get the value of a key from a request whose lines were already split, or an empty
+ * string if it is missing
+ */
+static const char *get_request_entry(const char *request, size_t len, const char *key) {
+    size_t key_len = strlen(key);
+
+    for (const char *line = request; line < request + len; line += strlen(line) + 1) {
+        if (strncmp(line, key, key_len) == 0 && line[key_len] == '=') {
+            return line + key_len + 1;
+        }
+    }
+
+    return "";
+}
+
+/**
+ * Send a message along with a file descriptor
+ */
+static bool send_with_fd(int socket_fd, const void *data, size_t len, int fd) {
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = {(void *)data, len};
+    struct msghdr message = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    return sendmsg(socket_fd, &message, MSG_NOSIGNAL) == (ssize_t)len;
+}
+
+/**
+ * Receive a message and the file descriptor sent along with it, -1 if there is none.
+ * Returns the length of the message, or -1 if it was not received whole
+ */
+static ssize_t receive_with_fd(int socket_fd, void *data, size_t size, int *fd) {
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = {data, size};
+    struct msghdr message = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+
+    *fd = -1;
+    ssize_t len = recvmsg(socket_fd, &message, MSG_CMSG_CLOEXEC);
+    if (len < 0) {
+        return -1;
+    }
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != NULL; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+            memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    if (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+        if (*fd != -1) {
+            close(*fd);
+            *fd = -1;
+        }
+        return -1;
+    }
+
+    return len;
+}
+
+/**
+ * Ask a running daemon to render the frame and print it. The request carries everything
+ * the daemon can not know by itself: the config file and distro logo in use, the display
+ * and the environment the per-client fields depend on. Our standard input is passed along
+ * so the terminal detection happens in our terminal. The daemon renders the frame into a
+ * memory file and sends it back, only we write to our standard output so a daemon that
+ * answers too late can not print a second frame.
+ *
+ * Returns false if there is no daemon running or it can not render the frame for us,
+ * then the frame must be rendered in-process
+ */
+bool request_frame(const char *config_file_path, const char *distro_logo) {
+    struct sockaddr_un address;
+    char config_identity[PATH_MAX];
+    char request[REQUEST_SIZE];
+    size_t len = 0;
+
+    if (!get_daemon_address(&address)) {
+        return false;
+    }
+    int daemon_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (daemon_fd == -1) {
+        return false;
+    }
+    if (connect(daemon_fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(daemon_fd);
+        return false;
+    }
+
+    get_config_identity(config_file_path, config_identity);
+    bool valid = append_request_entry(request, &len, "config", config_identity) &&
+                 append_request_entry(request, &len, "distro", distro_logo) &&
+                 append_request_entry(request, &len, "DISPLAY", getenv("DISPLAY"));
+    for (int i = 0; valid && i < COUNT(client_environment); i++) {
+        valid = append_request_entry(request, &len, client_environment[i], getenv(client_environment[i]));
+    }
+    if (!valid) {
+        close(daemon_fd);
+        return false;
+    }
+
+    struct timeval timeout = {DAEMON_TIMEOUT_MS / 1000, (DAEMON_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(daemon_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // Send the request along with our standard input, the reply comes with the frame
+    char reply = DAEMON_REFUSED;
+    int frame_fd = -1;
+    if (!send_with_fd(daemon_fd, request, len, STDIN_FILENO) || receive_with_fd(daemon_fd, &reply, 1, &frame_fd) != 1) {
+        reply = DAEMON_REFUSED;
+    }
+    close(daemon_fd);
+
+    bool rendered = reply == DAEMON_RENDERED && frame_fd != -1;
+    if (rendered) {
+        fflush(stdout);
+        copy_frame(frame_fd);
+    }
+    if (frame_fd != -1) {
+        close(frame_fd);
+    }
+
+    return rendered;
+}
+
+/**
+ * Render a frame for a client into a memory file, using its environment. Returns the file
+ * positioned at its start, or -1 if it can not be created
+ */
+static int render_client_frame(const char *request, size_t len, int client_stdin) {
+    int frame_fd = memfd_create("lcfetch-frame", MFD_CLOEXEC);
+    if (frame_fd == -1) {
+        return -1;
+    }
+
+    char *saved_environment[COUNT(client_environment)];
+    for (int i = 0; i < COUNT(client_environment); i++) {
+        const char *value = getenv(client_environment[i]);
+        saved_environment[i] = value != NULL ? xstrdup(value) : NULL;
+
+        value = get_request_entry(request, len, client_environment[i]);
+        if (*value) {
+            setenv(client_environment[i], value, 1);
+        } else {
+            unsetenv(client_environment[i]);
+        }
+    }
+    const char *distro_logo = get_request_entry(request, len, "distro");
+
+    fflush(stdout);
+    int saved_stdin = dup(STDIN_FILENO);
+    int saved_stdout = dup(STDOUT_FILENO);
+    dup2(client_stdin, STDIN_FILENO);
+    dup2(frame_fd, STDOUT_FILENO);
+
+    // Disable line wrapping so we can keep the logo intact on small terminals
+    frame_append("\e[?7l");
+    print_info(*distro_logo ? (char *)distro_logo : NULL);
+    frame_append("\e[?7h");
+    flush_frame();
+
+    dup2(saved_stdin, STDIN_FILENO);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdin);
+    close(saved_stdout);
+
+    for (int i = 0; i < COUNT(client_environment); i++) {
+        if (saved_environment[i] != NULL) {
+            setenv(client_environment[i], saved_environment[i], 1);
+            xfree(saved_environment[i]);
+        } else {
+            unsetenv(client_environment[i]);
+        }
+    }
+
+    // The client reads it through its own descriptor, which shares this file position
+    lseek(frame_fd, 0, SEEK_SET);
+
+    return frame_fd;
+}
+
+/**
+ * Serve a client request, the frame is only rendered for clients that share our user,
+ * configuration file and display
+ */
+static void serve_client(int client_fd, const char *config_identity) {
+    char request[REQUEST_SIZE];
+    int client_stdin;
+
+    // Do not let a stuck client block the other ones, the daemon only ever writes to the
+    // client socket so nothing else can block it
+    struct timeval timeout = {DAEMON_TIMEOUT_MS / 1000, (DAEMON_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    ssize_t len = receive_with_fd(client_fd, request, sizeof(request) - 1, &client_stdin);
+    if (len <= 0) {
+        if (client_stdin != -1) {
+            close(client_stdin);
+        }
+        return;
+    }
+    // Split the request lines so every value can be used directly
+    request[len] = '\0';
+    for (char *newline = strchr(request, '\n'); newline != NULL; newline = strchr(newline + 1, '\n')) {
+        *newline = '\0';
+    }
+
+    struct ucred credentials;
+    socklen_t credentials_len = sizeof(credentials);
+    bool same_user = getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &credentials, &credentials_len) == 0 &&
+                     credentials.uid == getuid();
+    const char *x_display = getenv("DISPLAY");
+
+    int frame_fd = -1;
+    if (same_user && client_stdin != -1 && strcmp(get_request_entry(request, len, "config"), config_identity) == 0 &&
+        strcmp(get_request_entry(request, len, "DISPLAY"), x_display != NULL ? x_display : "") == 0) {
+        frame_fd = render_client_frame(request, len, client_stdin);
+    }
+    if (frame_fd != -1) {
+        char reply = DAEMON_RENDERED;
+        send_with_fd(client_fd, &reply, 1, frame_fd);
+        close(frame_fd);
+    } else {
+        char reply = DAEMON_REFUSED;
+        send(client_fd, &reply, 1, MSG_NOSIGNAL);
+    }
+
+    if (client_stdin != -1) {
+        close(client_stdin);
+    }
+}
+
+static long long get_monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * Run the resident daemon until it gets SIGINT or SIGTERM. It keeps the Lua configuration,
+ * the X display and the collected fields in memory so the clients only wait for the frame
+ * to be rendered. The uptime and memory are collected again every second, the other fields
+ * when they change like in watch mode (see start_change_watch)
+ */
+void run_daemon(const char *config_file_path) {
+    struct sockaddr_un address;
+    char config_identity[PATH_MAX];
+
+    if (!get_daemon_address(&address)) {
+        log_error("Unable to get the daemon socket path, set $XDG_RUNTIME_DIR");
+        exit(1);
+    }
+    get_config_identity(config_file_path, config_identity);
+
+    int listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    int probe_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1 || probe_fd == -1) {
+        log_error("Unable to create the daemon socket: %s", strerror(errno));
+        exit(1);
+    }
+    // Remove the socket of a previous daemon, unless it is still running
+    if (connect(probe_fd, (struct sockaddr *)&address, sizeof(address)) == 0) {
+        log_error("The lcfetch daemon is already running (%s)", address.sun_path);
+        exit(1);
+    }
+    close(probe_fd);
+    unlink(address.sun_path);
+
+    mode_t previous_umask = umask(0077);
+    if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listen_fd, 16) != 0) {
+        log_error("Unable to listen on %s: %s", address.sun_path, strerror(errno));
+        exit(1);
+    }
+    umask(previous_umask);
+
+    struct sigaction stop_action = {.sa_handler = stop_daemon};
+    sigemptyset(&stop_action.sa_mask);
+    sigaction(SIGINT, &stop_action, NULL);
+    sigaction(SIGTERM, &stop_action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!start_change_watch()) {
+        log_error("Unable to watch the system information: %s", strerror(errno));
+        exit(1);
+    }
+    refresh_warm_fields(NULL, false);
+    reset_arena();
+    long long next_refresh = get_monotonic_ms() + DAEMON_REFRESH_INTERVAL_MS;
+    while (daemon_running) {
+        bool stale[FIELD_KINDS] = {false};
+        struct pollfd fds[1 + MAX_CHANGE_WATCH_FDS] = {{listen_fd, POLLIN, 0}};
+        int fds_count = 1 + get_change_watch_fds(fds + 1);
+        long long timeout = next_refresh - get_monotonic_ms();
+        if (timeout > 0 && poll(fds, fds_count, timeout) > 0 && (fds[0].revents & POLLIN)) {
+            int client_fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (client_fd != -1) {
+                serve_client(client_fd, config_identity);
+                close(client_fd);
+            }
+        }
+
+        read_changes(stale);
+        if (get_monotonic_ms() >= next_refresh) {
+            stale[FIELD_UPTIME] = stale[FIELD_MEMORY] = true;
+            next_refresh = get_monotonic_ms() + DAEMON_REFRESH_INTERVAL_MS;
+        }
+        bool any_stale = false;
+        for (int kind = 0; kind < FIELD_KINDS; kind++) {
+            any_stale |= stale[kind];
+        }
+        if (any_stale) {
+            refresh_warm_fields(stale, true);
+        }
+        // Everything allocated for the frames and refreshes is released at once
+        reset_arena();
+    }
+
+    close(listen_fd);
+    unlink(address.sun_path);
+    stop_change_watch();
+    free_warm_fields();
+}
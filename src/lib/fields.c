@@ -0,0 +1,482 @@
+/* C stdlib */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+/* Custom headers */
+#include "lcfetch.h"
+
+// Maximum number of threads used for collecting the fields
+#define MAX_FIELD_WORKERS 8
+// Maximum number of files read by a collector
+#define MAX_FIELD_FILES 2
+// Maximum number of options read by a collector
+#define MAX_FIELD_OPTIONS 3
+// Maximum time to wait for another instance that is collecting the same fields
+#define HERD_TIMEOUT_MS 5000
+// The fields enabled in the last run and their options, collected speculatively while the
+// configuration file runs
+#define ENABLED_FIELDS_CACHE_NAME "enabled_fields"
+
+static char *get_pretty_os() { return get_os(true); }
+
+/**
+ * Information fields, indexed by their kind. Fields without a collector are
+ * rendered directly by print_info (e.g. colors) or print_field (e.g. user).
+ * Per-client fields depend on the environment of the process that prints them
+ * so the daemon never keeps them warm. The files are read by the collector and
+ * prefetched all together before collecting the fields, the options change the
+ * collected value
+ */
+static const struct {
+    const char *name;
+    char *(*collect)(void);
+    bool per_client;
+    bool uses_display;
+    const char *files[MAX_FIELD_FILES];
+    const char *options[MAX_FIELD_OPTIONS];
+} field_table[FIELD_KINDS] = {
+    [FIELD_NEWLINE] = {"", NULL, false, false, {NULL}, {NULL}},
+    [FIELD_USER] = {"user", NULL, false, false, {NULL}, {NULL}},
+    [FIELD_SEPARATOR] = {"separator", NULL, false, false, {NULL}, {NULL}},
+    [FIELD_OS] = {"os", get_pretty_os, false, false, {"/etc/os-release"}, {"show_arch"}},
+    [FIELD_KERNEL] = {"kernel", get_kernel, false, false, {NULL}, {NULL}},
+    [FIELD_UPTIME] = {"uptime", get_uptime, false, false, {NULL}, {NULL}},
+    [FIELD_PACKAGES] = {"packages", get_packages, false, false, {NULL}, {NULL}},
+    [FIELD_WM] = {"wm", get_wm, false, true, {NULL}, {NULL}},
+    [FIELD_RESOLUTION] = {"resolution",
+                          get_resolution,
+                          false,
+                          true,
+                          {NULL},
+                          {"display_refresh_rate", "group_monitors"}},
+    [FIELD_SHELL] = {"shell", get_shell, true, false, {NULL}, {NULL}},
+    [FIELD_TERMINAL] = {"terminal", get_terminal, true, true, {NULL}, {NULL}},
+    [FIELD_CPU] = {"cpu",
+                   get_cpu,
+                   false,
+                   false,
+                   {"/proc/cpuinfo", "/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq"},
+                   {"short_cpu_info", "cpu_topology"}},
+    [FIELD_MEMORY] = {"memory", get_memory, false, false, {"/proc/meminfo"}, {"memory_in_gib"}},
+    [FIELD_COLORS] = {"colors", NULL, false, false, {NULL}, {NULL}},
+    [FIELD_UNKNOWN] = {NULL, NULL, false, false, {NULL}, {NULL}},
+};
+
+// Values kept in memory by the daemon and the watch mode between renders, see refresh_warm_fields
+static char *warm_values[FIELD_KINDS];
+
+/**
+ * Fields collected while the configuration file runs, see start_speculative_collection. The
+ * values are only used if the options they were collected with did not change
+ */
+static field_kind speculative_fields[FIELD_KINDS];
+static int speculative_fields_count = 0;
+static char *speculative_values[FIELD_KINDS];
+static char speculative_signatures[FIELD_KINDS][BUF_SIZE];
+static bool last_enabled[FIELD_KINDS];
+static char last_signatures[FIELD_KINDS][BUF_SIZE];
+static pthread_t speculation_thread;
+static bool speculating = false;
+
+/**
+ * Get the kind of a field from its (case-insensitive) name
+ */
+field_kind get_field_kind(const char *name) {
+    for (int kind = 0; kind < FIELD_UNKNOWN; kind++) {
+        if (strcasecmp(name, field_table[kind].name) == 0) {
+            return kind;
+        }
+    }
+    return FIELD_UNKNOWN;
+}
+
+/**
+ * Get the (lowercase) name of a field kind
+ */
+const char *get_field_name(field_kind kind) { return field_table[kind].name; }
+
+/**
+ * Check if any of the enabled fields queries the X server
+ */
+bool enabled_fields_use_display(void) {
+    for (int i = 0; i < options.enabled_fields_count; i++) {
+        if (field_table[options.enabled_fields[i]].uses_display) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Compute the signature of the options a field is collected with, including its cache
+ * time to live as the value could come from the cache
+ */
+static void sign_field_options(field_kind kind, char signature[BUF_SIZE]) {
+    // Exact so the time to live can be read back, see apply_field_options
+    int len = snprintf(signature, BUF_SIZE, "ttl=%.17g;", options.cache_ttl[kind]);
+    for (int i = 0; i < MAX_FIELD_OPTIONS && field_table[kind].options[i] != NULL; i++) {
+        const char *option = field_table[kind].options[i];
+        len += snprintf(signature + len, BUF_SIZE - len, "%s=%d;", option, get_option_boolean(option));
+    }
+}
+
+/**
+ * Set the options a field was collected with from their signature, see sign_field_options
+ */
+static void apply_field_options(field_kind kind, const char *signature) {
+    char option[BUF_SIZE];
+
+    for (const char *end = strchr(signature, ';'); end != NULL; signature = end + 1, end = strchr(signature, ';')) {
+        const char *value = memchr(signature, '=', end - signature);
+        if (value == NULL || (size_t)(value - signature) >= sizeof(option)) {
+            continue;
+        }
+        snprintf(option, sizeof(option), "%.*s", (int)(value - signature), signature);
+        if (strcmp(option, "ttl") == 0) {
+            options.cache_ttl[kind] = strtod(value + 1, NULL);
+        } else {
+            set_option_boolean(option, atoi(value + 1));
+        }
+    }
+}
+
+/**
+ * Take the speculative value of a field if the options did not change since it was collected.
+ * The returned value is allocated in the arena
+ */
+static bool take_speculative_field(field_kind kind, char **value) {
+    if (speculative_values[kind] == NULL) {
+        return false;
+    }
+
+    char signature[BUF_SIZE];
+    sign_field_options(kind, signature);
+    bool valid = strcmp(signature, speculative_signatures[kind]) == 0;
+    if (valid) {
+        *value = arena_strdup(speculative_values[kind]);
+    }
+    xfree(speculative_values[kind]);
+    speculative_values[kind] = NULL;
+
+    return valid;
+}
+
+/**
+ * Release the speculative values that were not taken, e.g. fields disabled by the configuration file
+ */
+static void free_speculative_fields(void) {
+    for (int kind = 0; kind < FIELD_KINDS; kind++) {
+        if (speculative_values[kind] != NULL) {
+            xfree(speculative_values[kind]);
+            speculative_values[kind] = NULL;
+        }
+    }
+}
+
+/**
+ * Work queue shared by the collector threads
+ */
+typedef struct field_jobs {
+    field_kind kinds[FIELD_KINDS];
+    int count;
+    int next;
+    char **values;
+    pthread_mutex_t lock;
+} field_jobs;
+
+static void *field_worker(void *arg) {
+    field_jobs *jobs = arg;
+
+    while (true) {
+        pthread_mutex_lock(&jobs->lock);
+        int job = jobs->next < jobs->count ? jobs->next++ : -1;
+        pthread_mutex_unlock(&jobs->lock);
+        if (job == -1) {
+            break;
+        }
+
+        // Every job writes to its own slot so there is no need to lock here
+        field_kind kind = jobs->kinds[job];
+        jobs->values[kind] = field_table[kind].collect();
+    }
+
+    return NULL;
+}
+
+/**
+ * Collect the value of every enabled field. The collectors do not share any state so they
+ * run on a small pool of threads and the total cost is about the slowest one.
+ *
+ * The fields marked in 'changed' (indexed by field kind, it can be NULL) are known to have
+ * changed, e.g. the X server notified it, so they are always collected and cached again.
+ *
+ * Returns the values indexed by field kind, NULL when a field has no value. They are
+ * allocated in the arena
+ */
+char **collect_fields(const field_kind *fields, int fields_count, const bool *changed) {
+    field_jobs jobs = {.count = 0, .next = 0};
+    jobs.values = arena_alloc(FIELD_KINDS * sizeof(char *));
+    memset(jobs.values, 0, FIELD_KINDS * sizeof(char *));
+    pthread_mutex_init(&jobs.lock, NULL);
+
+    bool queued[FIELD_KINDS] = {false};
+    bool cacheable_misses = false;
+    for (int i = 0; i < fields_count; i++) {
+        field_kind kind = fields[i];
+        // Collect repeated fields only once, and only if they are not warm or cached
+        if (field_table[kind].collect != NULL && !queued[kind]) {
+            queued[kind] = true;
+            if (changed != NULL && changed[kind]) {
+                jobs.kinds[jobs.count++] = kind;
+            } else if (warm_values[kind] != NULL) {
+                jobs.values[kind] = arena_strdup(warm_values[kind]);
+            } else if (!take_speculative_field(kind, &jobs.values[kind]) &&
+                       !get_cached_field(kind, &jobs.values[kind])) {
+                jobs.kinds[jobs.count++] = kind;
+                cacheable_misses |= is_field_cacheable(kind);
+            }
+        }
+    }
+
+    // Only one of the instances started at the same time collects the slow fields, the
+    // others wait for it and take them from the cache
+    int herd_lock = -1;
+    if (cacheable_misses) {
+        bool waited;
+        herd_lock = acquire_herd_lock(HERD_TIMEOUT_MS, &waited);
+        if (waited) {
+            reload_fields_cache();
+            int misses = 0;
+            for (int i = 0; i < jobs.count; i++) {
+                field_kind kind = jobs.kinds[i];
+                if ((changed != NULL && changed[kind]) || !is_field_cacheable(kind) ||
+                    !get_cached_field(kind, &jobs.values[kind])) {
+                    jobs.kinds[misses++] = kind;
+                }
+            }
+            jobs.count = misses;
+        }
+    }
+
+    // Read the files of every collector at once instead of one after another
+    const char *files[FIELD_KINDS * MAX_FIELD_FILES];
+    int files_count = 0;
+    for (int i = 0; i < jobs.count; i++) {
+        for (int j = 0; j < MAX_FIELD_FILES && field_table[jobs.kinds[i]].files[j] != NULL; j++) {
+            files[files_count++] = field_table[jobs.kinds[i]].files[j];
+        }
+    }
+    prefetch_pseudo_files(files, files_count);
+
+    pthread_t workers[MAX_FIELD_WORKERS];
+    int workers_count = 0;
+    for (int i = 0; i + 1 < jobs.count && i < MAX_FIELD_WORKERS; i++) {
+        if (pthread_create(&workers[workers_count], NULL, field_worker, &jobs) == 0) {
+            workers_count++;
+        }
+    }
+    // Collect them here if we were not able to spawn any thread, or help the workers otherwise
+    field_worker(&jobs);
+    for (int i = 0; i < workers_count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    pthread_mutex_destroy(&jobs.lock);
+
+    for (int i = 0; i < jobs.count; i++) {
+        set_cached_field(jobs.kinds[i], jobs.values[jobs.kinds[i]]);
+    }
+    save_fields_cache();
+    release_herd_lock(herd_lock);
+    // Speculative values are only good for the first frame
+    free_speculative_fields();
+
+    return jobs.values;
+}
+
+/**
+ * Release the values kept in memory by refresh_warm_fields
+ */
+void free_warm_fields(void) {
+    for (int kind = 0; kind < FIELD_KINDS; kind++) {
+        if (warm_values[kind] != NULL) {
+            xfree(warm_values[kind]);
+            warm_values[kind] = NULL;
+        }
+    }
+}
+
+/**
+ * Collect again the enabled fields and keep them in memory, so collect_fields returns them
+ * without doing any work. If 'stale' is NULL then every field that does not depend on the
+ * client is collected, otherwise only the ones marked as stale (indexed by field kind).
+ * With 'changed' the stale fields are collected even if they are cached, see collect_fields
+ */
+void refresh_warm_fields(const bool *stale, bool changed) {
+    field_kind *fields = arena_alloc((options.enabled_fields_count + 1) * sizeof(field_kind));
+    int fields_count = 0;
+    for (int i = 0; i < options.enabled_fields_count; i++) {
+        field_kind kind = options.enabled_fields[i];
+        if (stale != NULL ? stale[kind] : !field_table[kind].per_client) {
+            if (warm_values[kind] != NULL) {
+                xfree(warm_values[kind]);
+                warm_values[kind] = NULL;
+            }
+            fields[fields_count++] = kind;
+        }
+    }
+
+    // The collected values are in the arena, keep a copy that outlives the frame
+    char **values = collect_fields(fields, fields_count, changed ? stale : NULL);
+    for (int kind = 0; kind < FIELD_KINDS; kind++) {
+        if (values[kind] != NULL) {
+            warm_values[kind] = xstrdup(values[kind]);
+        }
+    }
+}
+
+/**
+ * Load the fields enabled in the last run, one name per line followed by a tab and the
+ * signature of the options they were collected with. Those options are set again so the
+ * speculative collection computes (and caches) the same values as the last run
+ */
+static int load_last_enabled_fields(field_kind *fields) {
+    char *line = NULL;
+    size_t len;
+    int fields_count = 0;
+
+    char *path = get_cache_file_path(ENABLED_FIELDS_CACHE_NAME);
+    FILE *file = path != NULL ? fopen(path, "r") : NULL;
+    if (path != NULL) {
+        xfree(path);
+    }
+    if (file == NULL) {
+        return 0;
+    }
+
+    while (getline(&line, &len, file) != -1 && fields_count < FIELD_KINDS) {
+        line[strcspn(line, "\n")] = '\0';
+        char *signature = strchr(line, '\t');
+        if (signature != NULL) {
+            *signature++ = '\0';
+        }
+        field_kind kind = get_field_kind(line);
+        if (kind != FIELD_UNKNOWN && field_table[kind].collect != NULL && !last_enabled[kind]) {
+            last_enabled[kind] = true;
+            if (signature != NULL) {
+                snprintf(last_signatures[kind], BUF_SIZE, "%s", signature);
+                apply_field_options(kind, signature);
+            }
+            // The configuration file could disable X, do not open the display before knowing it
+            if (!field_table[kind].uses_display) {
+                fields[fields_count++] = kind;
+            }
+        }
+    }
+    if (line != NULL) {
+        xfree(line);
+    }
+    fclose(file);
+
+    return fields_count;
+}
+
+static void *speculation_worker(void *arg) {
+    (void)arg;
+
+    char **values = collect_fields(speculative_fields, speculative_fields_count, NULL);
+    // The arena could be reset before the values are taken
+    for (int i = 0; i < speculative_fields_count; i++) {
+        field_kind kind = speculative_fields[i];
+        if (values[kind] != NULL) {
+            speculative_values[kind] = xstrdup(values[kind]);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Start collecting in the background the fields enabled in the last run with their options
+ * of the last run, or the enabled fields of the current options if they are not known yet,
+ * so collecting them overlaps with running the configuration file. The fields that query
+ * the X server are left out. The current options must not change until
+ * finish_speculative_collection is called
+ */
+void start_speculative_collection(void) {
+    speculative_fields_count = load_last_enabled_fields(speculative_fields);
+    if (speculative_fields_count == 0) {
+        for (int i = 0; i < options.enabled_fields_count; i++) {
+            field_kind kind = options.enabled_fields[i];
+            if (field_table[kind].collect != NULL && !field_table[kind].uses_display) {
+                speculative_fields[speculative_fields_count++] = kind;
+            }
+        }
+    }
+    for (int i = 0; i < speculative_fields_count; i++) {
+        sign_field_options(speculative_fields[i], speculative_signatures[speculative_fields[i]]);
+    }
+
+    speculating = speculative_fields_count > 0 &&
+                  pthread_create(&speculation_thread, NULL, speculation_worker, NULL) == 0;
+}
+
+/**
+ * Wait for the speculative collection, the options can be changed afterwards
+ */
+void finish_speculative_collection(void) {
+    if (speculating) {
+        pthread_join(speculation_thread, NULL);
+        speculating = false;
+    }
+}
+
+/**
+ * Store the enabled fields of the current options and the options they are collected with
+ * for the speculative collection of the next run, only if they changed since the last one
+ */
+void remember_enabled_fields(void) {
+    bool enabled[FIELD_KINDS] = {false};
+    char signatures[FIELD_KINDS][BUF_SIZE] = {{0}};
+    bool changed = false;
+    for (int i = 0; i < options.enabled_fields_count; i++) {
+        field_kind kind = options.enabled_fields[i];
+        enabled[kind] = field_table[kind].collect != NULL;
+    }
+    for (int kind = 0; kind < FIELD_KINDS; kind++) {
+        if (enabled[kind]) {
+            sign_field_options(kind, signatures[kind]);
+            changed |= strcmp(signatures[kind], last_signatures[kind]) != 0;
+        }
+    }
+    if (!changed && memcmp(enabled, last_enabled, sizeof(enabled)) == 0) {
+        return;
+    }
+
+    char *path = get_cache_file_path(ENABLED_FIELDS_CACHE_NAME);
+    if (path == NULL) {
+        return;
+    }
+    char *tmp_path = xmalloc(strlen(path) + 16);
+    sprintf(tmp_path, "%s.%d", path, (int)getpid());
+
+    // Write it in a temporary file first so concurrent runs never read an incomplete list
+    FILE *file = fopen(tmp_path, "w");
+    if (file != NULL) {
+        for (int kind = 0; kind < FIELD_KINDS; kind++) {
+            if (enabled[kind]) {
+                fprintf(file, "%s\t%s\n", field_table[kind].name, signatures[kind]);
+            }
+        }
+        if (fclose(file) != 0 || rename(tmp_path, path) != 0) {
+            unlink(tmp_path);
+        }
+    }
+    memcpy(last_enabled, enabled, sizeof(enabled));
+    memcpy(last_signatures, signatures, sizeof(signatures));
+    xfree(tmp_path);
+    xfree(path);
+}
@@ -0,0 +1,84 @@
+/* C stdlib */
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+/* Custom headers */
+#include "lcfetch.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+/**
+ * The segments of the frame being rendered, written by a single writev
+ */
+static struct iovec *segments = NULL;
+static int segments_count = 0;
+static int segments_capacity = 0;
+
+/**
+ * Add a segment to the frame, it is referenced (not copied) so it must stay valid
+ * until the frame is flushed, e.g. the distro logo lines or strings from the arena
+ */
+void frame_append(const char *str) {
+    if (str == NULL || *str == '\0') {
+        return;
+    }
+    if (segments_count == segments_capacity) {
+        segments_capacity = segments_capacity > 0 ? segments_capacity * 2 : 64;
+        struct iovec *bigger_segments = xmalloc(segments_capacity * sizeof(struct iovec));
+        if (segments != NULL) {
+            memcpy(bigger_segments, segments, segments_count * sizeof(struct iovec));
+            xfree(segments);
+        }
+        segments = bigger_segments;
+    }
+    segments[segments_count++] = (struct iovec){(void *)str, strlen(str)};
+}
+
+/**
+ * Write the whole frame to the standard output with a single writev, so slow terminals get
+ * it at once. Frames with more than IOV_MAX segments need more than one writev
+ */
+void flush_frame(void) {
+    // Anything printed with stdio goes first
+    fflush(stdout);
+
+    struct iovec *pending = segments;
+    int pending_count = segments_count;
+    while (pending_count > 0) {
+        ssize_t written = writev(STDOUT_FILENO, pending, pending_count < IOV_MAX ? pending_count : IOV_MAX);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        // Skip the written segments, and the written part of the last one on short writes
+        while (pending_count > 0 && (size_t)written >= pending->iov_len) {
+            written -= pending->iov_len;
+            pending++;
+            pending_count--;
+        }
+        if (pending_count > 0) {
+            pending->iov_base = (char *)pending->iov_base + written;
+            pending->iov_len -= written;
+        }
+    }
+    segments_count = 0;
+}
+
+/**
+ * Release the segments list, e.g. before exiting
+ */
+void free_frame(void) {
+    if (segments != NULL) {
+        xfree(segments);
+        segments = NULL;
+    }
+    segments_count = segments_capacity = 0;
+}
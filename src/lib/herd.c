@@ -0,0 +1,61 @@
+/* C stdlib */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <sys/file.h>
+#include <time.h>
+#include <unistd.h>
+/* Custom headers */
+#include "lcfetch.h"
+
+#define HERD_LOCK_NAME "lcfetch.lock"
+// Interval between attempts to take the lock while another instance holds it
+#define HERD_POLL_INTERVAL_NS (10 * 1000 * 1000)
+
+/**
+ * Become the instance that collects the slow fields. When many instances start at once
+ * (e.g. restoring a tmux session) only one of them collects and caches the fields while
+ * the others wait for it, up to 'timeout_ms' milliseconds, and then read its results
+ * from the cache. The lock is released by the kernel if its holder dies, so the next
+ * instance in the queue takes over.
+ *
+ * 'waited' is set to true if another instance was holding the lock, so the cache
+ * must be read again. Returns the lock descriptor or -1 if there is no lock
+ */
+int acquire_herd_lock(int timeout_ms, bool *waited) {
+    struct timespec poll_interval = {0, HERD_POLL_INTERVAL_NS};
+    *waited = false;
+
+    // The lock file lives in $XDG_RUNTIME_DIR so it never survives a reboot
+    char *lock_path = get_runtime_file_path(HERD_LOCK_NAME);
+    if (lock_path == NULL) {
+        return -1;
+    }
+    int lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    xfree(lock_path);
+    if (lock_fd == -1) {
+        return -1;
+    }
+
+    for (int elapsed_ms = 0; flock(lock_fd, LOCK_EX | LOCK_NB) != 0; elapsed_ms += HERD_POLL_INTERVAL_NS / 1000000) {
+        // The leader is taking too long, stop waiting for it and collect the fields on our own
+        if ((errno != EWOULDBLOCK && errno != EINTR) || elapsed_ms >= timeout_ms) {
+            close(lock_fd);
+            return -1;
+        }
+        *waited = true;
+        nanosleep(&poll_interval, NULL);
+    }
+
+    return lock_fd;
+}
+
+/**
+ * Let the next waiting instance read the fields collected by this one
+ */
+void release_herd_lock(int lock_fd) {
+    if (lock_fd != -1) {
+        flock(lock_fd, LOCK_UN);
+        close(lock_fd);
+    }
+}
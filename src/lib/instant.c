@@ -0,0 +1,142 @@
+/* C stdlib */
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+/* Custom headers */
+#include "lcfetch.h"
+
+// Path of the frame being captured and of the temporary file it is written to
+static char *frame_path = NULL;
+static char *frame_tmp_path = NULL;
+// Original standard output while the frame is being captured
+static int saved_stdout = -1;
+
+/**
+ * Get the path of the cached frame. Every config file and distro logo has its own frame,
+ * e.g. /home/user/.cache/lcfetch/frame-1a2b3c4d
+ */
+char *get_frame_path(const char *config_file_path, const char *distro_logo) {
+    char frame_name[BUF_SIZE];
+    // djb2 hash
+    unsigned long hash = 5381;
+
+    for (const char *c = config_file_path != NULL ? config_file_path : ""; *c; c++) {
+        hash = hash * 33 + (unsigned char)*c;
+    }
+    hash = hash * 33 + '\n';
+    for (const char *c = distro_logo != NULL ? distro_logo : ""; *c; c++) {
+        hash = hash * 33 + (unsigned char)*c;
+    }
+    snprintf(frame_name, BUF_SIZE, "frame-%08lx", hash & 0xffffffffUL);
+
+    return get_cache_file_path(frame_name);
+}
+
+/**
+ * Copy a rendered frame from a file descriptor to the standard output, e.g. the cached frame
+ * or the frame rendered by the daemon
+ */
+void copy_frame(int fd) {
+    char buf[64 * 1024];
+    ssize_t nread;
+
+    while ((nread = read(fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t written = 0, n; written < nread; written += n) {
+            if ((n = write(STDOUT_FILENO, buf + written, nread - written)) <= 0) {
+                return;
+            }
+        }
+    }
+}
+
+/**
+ * Copy the cached frame to the standard output, returns false if there is no cached frame yet
+ */
+bool print_frame(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    copy_frame(fd);
+    close(fd);
+
+    return true;
+}
+
+/**
+ * Fork a detached process that keeps running lcfetch for refreshing the cached frame.
+ * Returns true in the refresher process and false in the original one, which
+ * can exit right away
+ */
+bool start_frame_refresh(void) {
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid != 0) {
+        // If we were unable to fork then there is nothing else to do, the frame is already printed
+        return false;
+    }
+
+    // Leave the terminal session and silence any error, nobody is going to read them
+    setsid();
+    int dev_null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (dev_null != -1) {
+        dup2(dev_null, STDERR_FILENO);
+        close(dev_null);
+    }
+
+    return true;
+}
+
+/**
+ * Redirect the standard output to a temporary file so the rendered frame can be cached
+ */
+void capture_frame(const char *path) {
+    frame_path = xstrdup(path);
+    frame_tmp_path = xmalloc(strlen(path) + 16);
+    sprintf(frame_tmp_path, "%s.%d", path, (int)getpid());
+
+    int fd = open(frame_tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        xfree(frame_path);
+        xfree(frame_tmp_path);
+        frame_path = frame_tmp_path = NULL;
+        return;
+    }
+    fflush(stdout);
+    saved_stdout = dup(STDOUT_FILENO);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+}
+
+/**
+ * Stop capturing the frame and atomically replace the cached one with it. If 'print' is true
+ * then the frame is also copied to the standard output, e.g. when there was no cached frame
+ */
+void store_frame(bool print) {
+    if (frame_path == NULL) {
+        return;
+    }
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    saved_stdout = -1;
+
+    if (rename(frame_tmp_path, frame_path) == 0) {
+        if (print) {
+            print_frame(frame_path);
+        }
+    } else {
+        if (print) {
+            print_frame(frame_tmp_path);
+        }
+        unlink(frame_tmp_path);
+    }
+    xfree(frame_path);
+    xfree(frame_tmp_path);
+    frame_path = frame_tmp_path = NULL;
+}
@@ -1,31 +1,182 @@
 /* C stdlib */
+#include <fcntl.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 /* Lua headers */
 #include <lauxlib.h>
 #include <lua.h>
 #include <lualib.h>
 /* Custom headers */
 #include "lcfetch.h"
+#include <log.h>
+
+// Identifies the compiled configuration files, see bytecode_header
+#define BYTECODE_MAGIC "LCFLUAC1"
 
 // Lua interpreter state
 static lua_State *lua;
+// The options read from the configuration file, see load_options
+lcfetch_options options;
 
 /**
- * Get the lcfetch configuration file path
+ * Get the lcfetch configuration file path, it must be freed by the caller
  */
 char *get_configuration_file_path() {
-    char *config_directory = getenv("XDG_CONFIG_HOME");
-    if (!config_directory) {
-        config_directory = strncat(getenv("HOME"), "/.config", -1);
+    char *config_file_path = xmalloc(PATH_MAX);
+    const char *config_directory = getenv("XDG_CONFIG_HOME");
+    const char *home = getenv("HOME");
+
+    if (config_directory != NULL) {
+        snprintf(config_file_path, PATH_MAX, "%s/lcfetch/config.lua", config_directory);
+    } else {
+        snprintf(config_file_path, PATH_MAX, "%s/.config/lcfetch/config.lua", home != NULL ? home : "");
     }
-    char *config_file_path = strncat(config_directory, "/lcfetch/config.lua", -1);
 
     return config_file_path;
 }
 
+/**
+ * Header of the compiled configuration files, the bytecode is only loaded if it was compiled
+ * by the same Lua version from the same configuration file, unchanged since then
+ */
+typedef struct bytecode_header {
+    char magic[8];
+    int lua_version;
+    dev_t config_device;
+    ino_t config_inode;
+    off_t config_size;
+    struct timespec config_mtime;
+    size_t config_path_len;
+} bytecode_header;
+
+/**
+ * Get the path of the compiled configuration file, e.g. /home/user/.cache/lcfetch/config-1a2b3c4d.luac
+ */
+static char *get_bytecode_path(const char *config_file) {
+    char bytecode_name[BUF_SIZE];
+    // djb2 hash
+    unsigned long hash = 5381;
+
+    for (const char *c = config_file; *c; c++) {
+        hash = hash * 33 + (unsigned char)*c;
+    }
+    snprintf(bytecode_name, BUF_SIZE, "config-%08lx.luac", hash & 0xffffffffUL);
+
+    return get_cache_file_path(bytecode_name);
+}
+
+static void fill_bytecode_header(bytecode_header *header, const char *config_file, const struct stat *config_st) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, BYTECODE_MAGIC, sizeof(header->magic));
+    header->lua_version = LUA_VERSION_NUM;
+    header->config_device = config_st->st_dev;
+    header->config_inode = config_st->st_ino;
+    header->config_size = config_st->st_size;
+    header->config_mtime = config_st->st_mtim;
+    header->config_path_len = strlen(config_file);
+}
+
+/**
+ * Load the compiled configuration file if it is still valid. It is never trusted unless it
+ * is a regular file owned by us that nobody else can write, and its header matches the
+ * configuration file. Returns false if it must be compiled again
+ */
+static bool load_bytecode(const char *bytecode_path, const char *config_file, const struct stat *config_st) {
+    bytecode_header expected, header;
+    struct stat st;
+    bool loaded = false;
+
+    int fd = open(bytecode_path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd == -1) {
+        return false;
+    }
+    fill_bytecode_header(&expected, config_file, config_st);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_uid == getuid() && (st.st_mode & 022) == 0 &&
+        st.st_size > (off_t)(sizeof(header) + expected.config_path_len) &&
+        read(fd, &header, sizeof(header)) == sizeof(header) && memcmp(&header, &expected, sizeof(header)) == 0) {
+        size_t size = st.st_size - sizeof(header);
+        char *buf = xmalloc(size);
+        if (read(fd, buf, size) == (ssize_t)size && memcmp(buf, config_file, header.config_path_len) == 0) {
+            // Only binary chunks, so a text file placed there is never run
+            loaded = luaL_loadbufferx(lua, buf + header.config_path_len, size - header.config_path_len,
+                                      config_file, "b") == LUA_OK;
+            if (!loaded) {
+                lua_pop(lua, 1);
+            }
+        }
+        xfree(buf);
+    }
+    close(fd);
+
+    return loaded;
+}
+
+static int write_bytecode_chunk(lua_State *L __attribute__((unused)), const void *chunk, size_t size, void *file) {
+    return fwrite(chunk, 1, size, file) != size;
+}
+
+/**
+ * Store the compiled configuration file at the top of the stack, it is written to a
+ * temporary file first so the other instances never read a partial one
+ */
+static void store_bytecode(const char *bytecode_path, const char *config_file, const struct stat *config_st) {
+    bytecode_header header;
+    char *tmp_path = xmalloc(strlen(bytecode_path) + 16);
+    sprintf(tmp_path, "%s.%d", bytecode_path, (int)getpid());
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    FILE *file = fd != -1 ? fdopen(fd, "wb") : NULL;
+    if (file == NULL) {
+        if (fd != -1) {
+            close(fd);
+        }
+        xfree(tmp_path);
+        return;
+    }
+    fill_bytecode_header(&header, config_file, config_st);
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(config_file, 1, header.config_path_len, file) == header.config_path_len &&
+                   lua_dump(lua, write_bytecode_chunk, file, 0) == 0;
+    if (fclose(file) != 0 || !written || rename(tmp_path, bytecode_path) != 0) {
+        unlink(tmp_path);
+    }
+    xfree(tmp_path);
+}
+
+/**
+ * Load the configuration file, from its compiled bytecode if it did not change since the
+ * last run so it is not parsed again. Returns the luaL_loadfile status
+ */
+static int load_configuration_file(const char *config_file) {
+    struct stat config_st;
+
+    if (stat(config_file, &config_st) != 0 || !S_ISREG(config_st.st_mode)) {
+        return luaL_loadfile(lua, config_file);
+    }
+    char *bytecode_path = get_bytecode_path(config_file);
+    if (bytecode_path != NULL && load_bytecode(bytecode_path, config_file, &config_st)) {
+        xfree(bytecode_path);
+        return LUA_OK;
+    }
+
+    int status = luaL_loadfile(lua, config_file);
+    if (status == LUA_OK && bytecode_path != NULL) {
+        store_bytecode(bytecode_path, config_file, &config_st);
+    }
+    if (bytecode_path != NULL) {
+        xfree(bytecode_path);
+    }
+
+    return status;
+}
+
 /**
  * Print Lua API stack to stdout, for debugging purposes
  * NOTE: remove the '__attribute__((unused))' statement when using it
@@ -55,33 +206,211 @@ static void __attribute__((unused)) dumpstack(lua_State *L) {
 }
 
 /**
- * Start the Lua interpreter and load the Lua interface functions
+ * Types of the options read into the snapshot
  */
-void start_lua(const char *config_file_path) {
-    char *config_file = (char *)config_file_path;
+typedef enum option_type {
+    OPTION_STRING,
+    OPTION_BOOLEAN,
+    OPTION_NUMBER,
+} option_type;
+
+/**
+ * Basic options of the snapshot and their default values, they are read from the 'options'
+ * table with the same name
+ */
+static const struct {
+    const char *name;
+    option_type type;
+    size_t offset;
+    const char *default_string;
+    lua_Number default_number;
+} option_table[] = {
+    {"accent_color", OPTION_STRING, offsetof(lcfetch_options, accent_color), "", 0},
+    {"ascii_distro", OPTION_STRING, offsetof(lcfetch_options, ascii_distro), "", 0},
+    {"colors_icon", OPTION_STRING, offsetof(lcfetch_options, colors_icon), "", 0},
+    {"colors_style", OPTION_STRING, offsetof(lcfetch_options, colors_style), "classic", 0},
+    {"delimiter", OPTION_STRING, offsetof(lcfetch_options, delimiter), ":", 0},
+    {"separator", OPTION_STRING, offsetof(lcfetch_options, separator), "-", 0},
+    {"show_arch", OPTION_BOOLEAN, offsetof(lcfetch_options, show_arch), NULL, true},
+    {"display_refresh_rate", OPTION_BOOLEAN, offsetof(lcfetch_options, display_refresh_rate), NULL, false},
+    {"group_monitors", OPTION_BOOLEAN, offsetof(lcfetch_options, group_monitors), NULL, false},
+    {"short_cpu_info", OPTION_BOOLEAN, offsetof(lcfetch_options, short_cpu_info), NULL, true},
+    {"cpu_topology", OPTION_BOOLEAN, offsetof(lcfetch_options, cpu_topology), NULL, false},
+    {"memory_in_gib", OPTION_BOOLEAN, offsetof(lcfetch_options, memory_in_gib), NULL, true},
+    {"display_logo", OPTION_BOOLEAN, offsetof(lcfetch_options, display_logo), NULL, true},
+    {"use_x11", OPTION_BOOLEAN, offsetof(lcfetch_options, use_x11), NULL, true},
+    {"x11_forwarded", OPTION_BOOLEAN, offsetof(lcfetch_options, x11_forwarded), NULL, false},
+    {"gap", OPTION_NUMBER, offsetof(lcfetch_options, gap), NULL, 3},
+    {"x11_timeout", OPTION_NUMBER, offsetof(lcfetch_options, x11_timeout), NULL, 250},
+};
+
+// Default fields messages, e.g. options.os_message
+static const char *default_messages[FIELD_KINDS] = {
+    [FIELD_OS] = "OS",
+    [FIELD_KERNEL] = "Kernel",
+    [FIELD_UPTIME] = "Uptime",
+    [FIELD_PACKAGES] = "Packages",
+    [FIELD_RESOLUTION] = "Resolution",
+    [FIELD_WM] = "WM",
+    [FIELD_SHELL] = "Shell",
+    [FIELD_TERMINAL] = "Terminal",
+    [FIELD_CPU] = "CPU",
+    [FIELD_MEMORY] = "Memory",
+};
+
+// Default options.enabled_fields, an empty string is a newline
+static const char *default_enabled_fields[] = {
+    "User", "Separator", "OS",       "Kernel", "Uptime", "Packages", "", "WM",     "Resolution",
+    "",     "Shell",     "Terminal", "",       "CPU",    "Memory",   "", "Colors",
+};
+
+/**
+ * Standard libraries opened right away, they only fill a table of functions. The package
+ * library is opened lazily, see open_lazy_library
+ */
+static const luaL_Reg libraries[] = {
+    {"_G", luaopen_base},            {LUA_STRLIBNAME, luaopen_string},  {LUA_TABLIBNAME, luaopen_table},
+    {LUA_MATHLIBNAME, luaopen_math}, {LUA_UTF8LIBNAME, luaopen_utf8},    {LUA_OSLIBNAME, luaopen_os},
+    {LUA_IOLIBNAME, luaopen_io},     {LUA_COLIBNAME, luaopen_coroutine}, {LUA_DBLIBNAME, luaopen_debug},
+};
+
+/**
+ * __index metamethod of the globals table, opens the package library the first time
+ * 'package' or 'require' is read. It builds the module searchers and reads the LUA_PATH and
+ * LUA_CPATH environment variables, which configuration files rarely need
+ */
+static int open_lazy_library(lua_State *L) {
+    const char *name = lua_tostring(L, 2);
+    if (name == NULL || (strcmp(name, LUA_LOADLIBNAME) != 0 && strcmp(name, "require") != 0)) {
+        return 0;
+    }
+
+    // Sets the globals too, so this is not called again for them
+    luaL_requiref(L, LUA_LOADLIBNAME, luaopen_package, 1);
+    lua_pop(L, 1);
+    lua_rawget(L, 1);
+
+    // Nothing else is lazy, drop the metatable unless the configuration file chained its own
+    if (lua_getmetatable(L, 1)) {
+        lua_getfield(L, -1, "__index");
+        bool is_lazy_metatable = lua_tocfunction(L, -1) == open_lazy_library;
+        lua_pop(L, 2);
+        if (is_lazy_metatable) {
+            lua_pushnil(L);
+            lua_setmetatable(L, 1);
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Open the standard libraries, the package library only when it is used
+ */
+static void open_libraries(void) {
+    for (int i = 0; i < COUNT(libraries); i++) {
+        luaL_requiref(lua, libraries[i].name, libraries[i].func, 1);
+        lua_pop(lua, 1);
+    }
+
+    lua_pushglobaltable(lua);
+    lua_newtable(lua);
+    lua_pushcfunction(lua, open_lazy_library);
+    lua_setfield(lua, -2, "__index");
+    lua_setmetatable(lua, -2);
+    lua_pop(lua, 1);
+}
+
+/**
+ * Fill the options snapshot with the default options, when there is no configuration file
+ */
+static void load_default_options(void) {
+    for (int i = 0; i < COUNT(option_table); i++) {
+        char *option = (char *)&options + option_table[i].offset;
+        switch (option_table[i].type) {
+        case OPTION_STRING:
+            *(const char **)option = xstrdup(option_table[i].default_string);
+            break;
+        case OPTION_BOOLEAN:
+            *(bool *)option = option_table[i].default_number;
+            break;
+        case OPTION_NUMBER:
+            *(int *)option = option_table[i].default_number;
+            break;
+        }
+    }
+    for (int kind = 0; kind < FIELD_UNKNOWN; kind++) {
+        options.messages[kind] = xstrdup(default_messages[kind] != NULL ? default_messages[kind] : "");
+    }
+    options.enabled_fields_count = COUNT(default_enabled_fields);
+    options.enabled_fields = xmalloc(options.enabled_fields_count * sizeof(field_kind));
+    for (int i = 0; i < options.enabled_fields_count; i++) {
+        options.enabled_fields[i] = get_field_kind(default_enabled_fields[i]);
+    }
+    options.custom_ascii_logo = NULL;
+    options.custom_ascii_logo_size = 0;
+    for (int kind = 0; kind < FIELD_KINDS; kind++) {
+        options.cache_ttl[kind] = -1;
+    }
+}
 
+/**
+ * Run the configuration file and take a snapshot of its options. Without a configuration
+ * file the default options are taken directly and no Lua state is created. The Lua state is
+ * closed right after taking the snapshot, nothing else needs it.
+ *
+ * The os_uname and pw globals must be set before, the fields are collected
+ * speculatively while the configuration file runs
+ */
+void start_lua(const char *config_file_path) {
+    struct stat st;
     // Get the default configuration path for lcfetch,
     // e.g. /home/user/.config/lcfetch/config.lua
-    if (config_file_path == NULL) {
-        config_file = get_configuration_file_path();
+    char *config_file =
+        config_file_path != NULL ? xstrdup(config_file_path) : get_configuration_file_path();
+
+    if (stat(config_file, &st) != 0) {
+        load_default_options();
+        xfree(config_file);
+        return;
     }
 
+    // Collect the fields that are likely enabled with the default options while the
+    // configuration file runs
+    load_default_options();
+    start_speculative_collection();
+
     // Create a pointer to an empty Lua environment
     lua = luaL_newstate();
+    // The configuration file is short-lived, collecting garbage while running it is a waste
+    lua_gc(lua, LUA_GCSTOP, 0);
     // Load the Lua libraries to make the Lua environment usable
-    luaL_openlibs(lua);
+    open_libraries();
     // Set the stack top to a specific value (0)
     lua_settop(lua, 0);
     // Load the default configurations
     init_options();
-    // Load the user configurations file
-    luaL_loadfile(lua, config_file) || lua_pcall(lua, 0, 0, 0);
+    // Load the user configurations file, the error message is at the top of the stack
+    if (load_configuration_file(config_file) != LUA_OK || lua_pcall(lua, 0, 0, 0) != LUA_OK) {
+        log_error("Unable to run the configuration file: %s", lua_tostring(lua, -1));
+        exit(1);
+    }
+    xfree(config_file);
+    // The collectors read the options, wait for them before replacing the default ones
+    finish_speculative_collection();
+    free_options();
+    // Take the options once the configuration file changed them
+    load_options();
+    remember_enabled_fields();
+
+    lua_close(lua);
+    lua = NULL;
 }
 
 /**
- * Stop the Lua interpreter
+ * Release the options taken by start_lua
  */
-void stop_lua(void) { lua_close(lua); }
+void stop_lua(void) { free_options(); }
 
 /**
  * Set default values to lcfetch configurations
@@ -91,30 +420,28 @@ void init_options(void) {
     lua_newtable(lua);
 
     // Set the default basic types options (strings, numbers, booleans)
-    set_table_string("accent_color", "");
-    set_table_string("ascii_distro", "");
-    set_table_string("colors_icon", "");
-    set_table_string("colors_style", "classic");
-    set_table_string("delimiter", ":");
-    set_table_string("separator", "-");
-    set_table_boolean("show_arch", 1);
-    set_table_boolean("display_refresh_rate", 0);
-    set_table_boolean("short_cpu_info", 1);
-    set_table_boolean("memory_in_gib", 1);
-    set_table_boolean("display_logo", 1);
-    set_table_number("gap", 3);
+    for (int i = 0; i < COUNT(option_table); i++) {
+        switch (option_table[i].type) {
+        case OPTION_STRING:
+            set_table_string(option_table[i].name, option_table[i].default_string);
+            break;
+        case OPTION_BOOLEAN:
+            set_table_boolean(option_table[i].name, option_table[i].default_number);
+            break;
+        case OPTION_NUMBER:
+            set_table_number(option_table[i].name, option_table[i].default_number);
+            break;
+        }
+    }
 
     // Fields messages
-    set_table_string("os_message", "OS");
-    set_table_string("kernel_message", "Kernel");
-    set_table_string("uptime_message", "Uptime");
-    set_table_string("packages_message", "Packages");
-    set_table_string("resolution_message", "Resolution");
-    set_table_string("wm_message", "WM");
-    set_table_string("shell_message", "Shell");
-    set_table_string("terminal_message", "Terminal");
-    set_table_string("cpu_message", "CPU");
-    set_table_string("memory_message", "Memory");
+    char message_option[BUF_SIZE];
+    for (int kind = 0; kind < FIELD_KINDS; kind++) {
+        if (default_messages[kind] != NULL) {
+            snprintf(message_option, BUF_SIZE, "%s_message", get_field_name(kind));
+            set_table_string(message_option, default_messages[kind]);
+        }
+    }
 
     // Set the global "options" table
     lua_setglobal(lua, "options");
@@ -122,134 +449,156 @@ void init_options(void) {
     // Create a new subtable in the "options" table
     set_table_subtable("enabled_fields");
     // Assign "options.enabled_fields" values
-    set_subtable_string("enabled_fields", "User");
-    set_subtable_string("enabled_fields", "Separator");
-    set_subtable_string("enabled_fields", "OS");
-    set_subtable_string("enabled_fields", "Kernel");
-    set_subtable_string("enabled_fields", "Uptime");
-    set_subtable_string("enabled_fields", "Packages");
-    set_subtable_string("enabled_fields", ""); // Newline
-    set_subtable_string("enabled_fields", "WM");
-    set_subtable_string("enabled_fields", "Resolution");
-    set_subtable_string("enabled_fields", ""); // Newline
-    set_subtable_string("enabled_fields", "Shell");
-    set_subtable_string("enabled_fields", "Terminal");
-    set_subtable_string("enabled_fields", ""); // Newline
-    set_subtable_string("enabled_fields", "CPU");
-    set_subtable_string("enabled_fields", "Memory");
-    set_subtable_string("enabled_fields", ""); // Newline
-    set_subtable_string("enabled_fields", "Colors");
+    for (int i = 0; i < COUNT(default_enabled_fields); i++) {
+        set_subtable_string("enabled_fields", default_enabled_fields[i]);
+    }
 }
 
 /**
- * Get a table size
+ * Copy a string of the snapshot so it does not depend on the Lua state, NULL (e.g. a
+ * missing option) is an empty string
  */
-int get_table_size(const char *table) {
-    int table_length = 0;
-
-    lua_getglobal(lua, "options");
-    if (luaL_getsubtable(lua, -1, table)) {
-        // Push the table length
-        lua_len(lua, -1);
-        table_length = luaL_checknumber(lua, -1);
-        // Remove the table length from the stack
-        lua_pop(lua, 1);
-    }
-
-    return table_length;
-}
+static const char *intern_string(const char *str) { return xstrdup(str != NULL ? str : ""); }
 
 /**
- * Check if a given string is in the given table
+ * Read a list of strings from a subtable of the table at the top of the stack. Returns the
+ * number of strings, the list is NULL if there are none
  */
-bool table_contains_string(const char *table, const char *key) {
-    const char *value = NULL;
-
-    lua_getglobal(lua, "options");
-    if (luaL_getsubtable(lua, -1, table)) {
-        int table_length = get_table_size(table);
-        // Iterate over all the table elements
-        for (int i = 1; i <= table_length; i++) {
-            // Get and store the current index value in the table
+static int read_string_list(const char *table, const char ***list) {
+    int count = 0;
+
+    *list = NULL;
+    if (lua_getfield(lua, -1, table) == LUA_TTABLE) {
+        count = luaL_len(lua, -1);
+        *list = xmalloc((count + 1) * sizeof(char *));
+        for (int i = 1; i <= count; i++) {
             lua_rawgeti(lua, -1, i);
-            value = luaL_checkstring(lua, -1);
-            // Remove the value from the stack
-            lua_pop(lua, 1);
-            // If the wanted value is in the table (case-insensitive)
-            // then let's return 1 and break the bucle
-            if (strcasecmp(value, key) == 0) {
-                return true;
+            if (!lua_isstring(lua, -1)) {
+                log_error("The element %d of '%s' is not a string", i, table);
+                exit(1);
             }
+            (*list)[i - 1] = intern_string(lua_tostring(lua, -1));
+            lua_pop(lua, 1);
         }
     }
-    lua_pop(lua, 2);
+    lua_pop(lua, 1);
 
-    return false;
+    return count;
 }
 
 /**
- * Get a boolean option from the configuration file
+ * Read the 'options' table into the options snapshot, so the rest of lcfetch reads plain
+ * memory instead of querying the Lua stack for every option
  */
-bool get_option_boolean(const char *opt) {
-    bool bool_opt;
-
+void load_options(void) {
     lua_getglobal(lua, "options");
-    lua_getfield(lua, -1, opt);
-    bool_opt = lua_toboolean(lua, -1);
-    lua_pop(lua, -1);
+    if (!lua_istable(lua, -1)) {
+        log_error("The 'options' table was overwritten by the configuration file");
+        exit(1);
+    }
 
-    return bool_opt;
-}
+    for (int i = 0; i < COUNT(option_table); i++) {
+        char *option = (char *)&options + option_table[i].offset;
+        lua_getfield(lua, -1, option_table[i].name);
+        switch (option_table[i].type) {
+        case OPTION_STRING:
+            *(const char **)option = intern_string(lua_tostring(lua, -1));
+            break;
+        case OPTION_BOOLEAN:
+            *(bool *)option = lua_toboolean(lua, -1);
+            break;
+        case OPTION_NUMBER:
+            *(int *)option = lua_tonumber(lua, -1);
+            break;
+        }
+        lua_pop(lua, 1);
+    }
 
-/**
- * Get a string option from the configuration file
- */
-const char *get_option_string(const char *opt) {
-    const char *str = NULL;
+    char message_option[BUF_SIZE];
+    for (int kind = 0; kind < FIELD_UNKNOWN; kind++) {
+        snprintf(message_option, BUF_SIZE, "%s_message", get_field_name(kind));
+        lua_getfield(lua, -1, message_option);
+        options.messages[kind] = intern_string(lua_tostring(lua, -1));
+        lua_pop(lua, 1);
+    }
 
-    lua_getglobal(lua, "options");
-    lua_getfield(lua, -1, opt);
-    str = lua_tostring(lua, -1);
-    lua_pop(lua, -1);
+    const char **fields;
+    options.enabled_fields_count = read_string_list("enabled_fields", &fields);
+    options.enabled_fields = xmalloc((options.enabled_fields_count + 1) * sizeof(field_kind));
+    for (int i = 0; i < options.enabled_fields_count; i++) {
+        options.enabled_fields[i] = get_field_kind(fields[i]);
+        if (options.enabled_fields[i] == FIELD_UNKNOWN) {
+            log_error("Field '%s' doesn't exists", fields[i]);
+            exit(1);
+        }
+        xfree((char *)fields[i]);
+    }
+    if (fields != NULL) {
+        xfree(fields);
+    }
+
+    options.custom_ascii_logo_size = read_string_list("custom_ascii_logo", &options.custom_ascii_logo);
 
-    return str;
+    for (int kind = 0; kind < FIELD_KINDS; kind++) {
+        options.cache_ttl[kind] = -1;
+    }
+    if (lua_getfield(lua, -1, "cache_ttl") == LUA_TTABLE) {
+        for (int kind = 0; kind < FIELD_UNKNOWN; kind++) {
+            lua_getfield(lua, -1, get_field_name(kind));
+            if (lua_isnumber(lua, -1)) {
+                options.cache_ttl[kind] = lua_tonumber(lua, -1);
+            }
+            lua_pop(lua, 1);
+        }
+    }
+    lua_pop(lua, 2);
 }
 
 /**
- * Get a number option from the configuration file
+ * Release the options snapshot
  */
-lua_Number get_option_number(const char *opt) {
-    lua_Number number;
+void free_options(void) {
+    for (int i = 0; i < COUNT(option_table); i++) {
+        if (option_table[i].type == OPTION_STRING) {
+            xfree(*(char **)((char *)&options + option_table[i].offset));
+        }
+    }
+    for (int kind = 0; kind < FIELD_UNKNOWN; kind++) {
+        xfree((char *)options.messages[kind]);
+    }
+    xfree(options.enabled_fields);
+    for (int i = 0; i < options.custom_ascii_logo_size; i++) {
+        xfree((char *)options.custom_ascii_logo[i]);
+    }
+    if (options.custom_ascii_logo != NULL) {
+        xfree(options.custom_ascii_logo);
+    }
+    memset(&options, 0, sizeof(options));
+}
 
-    lua_getglobal(lua, "options");
-    lua_getfield(lua, -1, opt);
-    number = lua_tonumber(lua, -1);
-    lua_pop(lua, -1);
+/**
+ * Get a boolean option by its name, e.g. for the options that change a cached field
+ */
+bool get_option_boolean(const char *opt) {
+    for (int i = 0; i < COUNT(option_table); i++) {
+        if (option_table[i].type == OPTION_BOOLEAN && strcmp(option_table[i].name, opt) == 0) {
+            return *(bool *)((char *)&options + option_table[i].offset);
+        }
+    }
 
-    return number;
+    return false;
 }
 
 /**
- * Get a table value from a subtable in the configuration file
+ * Set a boolean option by its name, e.g. for collecting the fields with the options of the
+ * last run before the configuration file runs
  */
-const char *get_subtable_string(const char *table, int index) {
-    const char *value = NULL;
-
-    lua_getglobal(lua, "options");
-    if (luaL_getsubtable(lua, -1, table)) {
-        int table_length = get_table_size(table);
-        // If the wanted index is higher than the table length then return NULL
-        if (table_length < index) {
-            lua_pop(lua, 1);
-            return value;
+void set_option_boolean(const char *opt, bool value) {
+    for (int i = 0; i < COUNT(option_table); i++) {
+        if (option_table[i].type == OPTION_BOOLEAN && strcmp(option_table[i].name, opt) == 0) {
+            *(bool *)((char *)&options + option_table[i].offset) = value;
         }
-        lua_rawgeti(lua, -1, index);
-        value = luaL_checkstring(lua, -1);
-        lua_pop(lua, 1);
     }
-    lua_pop(lua, 2);
-
-    return value;
 }
 
 /**
@@ -290,7 +639,9 @@ int set_table_number(const char *key, lua_Number value) {
  */
 int set_table_subtable(const char *key) {
     lua_getglobal(lua, "options");
-    lua_setfield(lua, -1, key);
+    lua_newtable(lua);
+    lua_setfield(lua, -2, key);
+    lua_pop(lua, 1);
 
     return 0;
 }
@@ -300,14 +651,11 @@ int set_table_subtable(const char *key) {
  */
 int set_subtable_string(const char *table, const char *key) {
     lua_getglobal(lua, "options");
-    if (luaL_getsubtable(lua, -1, table)) {
-        int table_length = get_table_size(table);
-        // Push the new value
-        lua_pushstring(lua, key);
-        lua_rawseti(lua, -2, table_length + 1);
-        lua_pop(lua, 2);
-    }
-    lua_pop(lua, 1);
+    luaL_getsubtable(lua, -1, table);
+    // Push the new value
+    lua_pushstring(lua, key);
+    lua_rawseti(lua, -2, luaL_len(lua, -2) + 1);
+    lua_pop(lua, 2);
 
     return 0;
 }
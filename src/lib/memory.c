@@ -1,10 +1,16 @@
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <log.h>
 
+#include "lcfetch.h"
+
+// Size of the arena blocks, bigger allocations get a block of their own
+#define ARENA_BLOCK_SIZE (BUF_SIZE * 64)
+
 /**
  * A malloc() wrapper that checks the results and dies in case of error
  */
@@ -18,6 +24,17 @@ void *xmalloc(size_t size) {
     return ptr;
 }
 
+/**
+ * A strdup() wrapper that dies in case of error
+ */
+char *xstrdup(const char *str) {
+    size_t len = strlen(str) + 1;
+    char *copy = xmalloc(len);
+    memcpy(copy, str, len);
+
+    return copy;
+}
+
 /**
  * A free() wrapper that dies if fed with NULL pointer
  */
@@ -29,3 +46,90 @@ void xfree(void *ptr) {
 
     free(ptr);
 }
+
+// Alignment suitable for anything allocated in the arena
+typedef union arena_align {
+    long double d;
+    long long l;
+    void *p;
+} arena_align;
+
+/**
+ * The render arena, a list of blocks where the memory is bumped from. The strings built for
+ * a frame (collected fields, accents, gaps, etc) live there and they are all released at once
+ * by reset_arena when the frame is done, so nothing allocated for a frame can leak
+ */
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+    arena_align data[];
+} arena_block;
+
+static arena_block *arena = NULL;
+// The collectors run on several threads
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Allocate memory that lives until the next reset_arena, it must not be freed
+ */
+void *arena_alloc(size_t size) {
+    // Keep every allocation aligned for any type
+    size = (size + sizeof(arena_align) - 1) / sizeof(arena_align) * sizeof(arena_align);
+
+    pthread_mutex_lock(&arena_lock);
+    if (arena == NULL || arena->size - arena->used < size) {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        arena_block *block = xmalloc(sizeof(arena_block) + block_size);
+        block->size = block_size;
+        block->used = 0;
+        block->next = arena;
+        arena = block;
+    }
+    void *ptr = (char *)arena->data + arena->used;
+    arena->used += size;
+    pthread_mutex_unlock(&arena_lock);
+
+    return ptr;
+}
+
+/**
+ * A strdup() that allocates the copy in the arena
+ */
+char *arena_strdup(const char *str) {
+    size_t len = strlen(str) + 1;
+    char *copy = arena_alloc(len);
+    memcpy(copy, str, len);
+
+    return copy;
+}
+
+/**
+ * Release everything allocated in the arena. The last block is kept for the next frame so the
+ * daemon and the watch mode do not allocate again on every render
+ */
+void reset_arena(void) {
+    pthread_mutex_lock(&arena_lock);
+    while (arena != NULL && arena->next != NULL) {
+        arena_block *next = arena->next;
+        free(arena);
+        arena = next;
+    }
+    if (arena != NULL) {
+        arena->used = 0;
+    }
+    pthread_mutex_unlock(&arena_lock);
+}
+
+/**
+ * Release the arena blocks, e.g. before exiting
+ */
+void free_arena(void) {
+    pthread_mutex_lock(&arena_lock);
+    while (arena != NULL) {
+        arena_block *next = arena->next;
+        free(arena);
+        arena = next;
+    }
+    pthread_mutex_unlock(&arena_lock);
+}
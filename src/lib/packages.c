@@ -0,0 +1,861 @@
+/* C stdlib */
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#include <unistd.h>
+/* SQLite and zlib headers */
+#include <sqlite3.h>
+#include <zlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+/* Custom headers */
+#include "lcfetch.h"
+#include <log.h>
+
+#define DPKG_STATUS_PATH "/var/lib/dpkg/status"
+#define PACMAN_LOCAL_PATH "/var/lib/pacman/local"
+#define PACMAN_SYNC_PATH "/var/lib/pacman/sync"
+#define PORTAGE_DB_PATH "/var/db/pkg"
+#define APK_INSTALLED_PATH "/lib/apk/db/installed"
+#define XBPS_PKGDB_PATH "/var/db/xbps/pkgdb-0.38.plist"
+#define FLATPAK_APP_PATH "/var/lib/flatpak/app"
+#define FLATPAK_RUNTIME_PATH "/var/lib/flatpak/runtime"
+#define DNF_PACKAGES_PATH "/var/cache/dnf/packages.db"
+#define RPMDB_SQLITE_PATH "/var/lib/rpm/rpmdb.sqlite"
+#define NIX_DB_PATH "/nix/var/nix/db/db.sqlite"
+#define NIX_SYSTEM_PROFILE_PATH "/run/current-system/sw"
+
+// Size of the buffer handed to getdents64, big enough to read most package
+// databases directories in a single system call
+#define DIRENTS_BUF_SIZE (64 * 1024)
+
+// Version of the pacman sync index cache format
+#define SYNC_INDEX_VERSION 1
+#define TAR_BLOCK_SIZE 512
+
+// dpkg writes one 'Status:' line per stanza, fully installed packages are the ones
+// that 'dpkg --list' reports as 'ii'
+static const char dpkg_status_key[] = "\nStatus: ";
+static const char dpkg_installed[] = "install ok installed";
+
+/**
+ * Map a whole file in memory for reading, returns NULL if it does not exist or is empty
+ */
+static char *map_file(const char *path, size_t *size) {
+    struct stat st;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return NULL;
+    }
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    char *buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (buf == MAP_FAILED) {
+        return NULL;
+    }
+    madvise(buf, st.st_size, MADV_SEQUENTIAL);
+    *size = st.st_size;
+
+    return buf;
+}
+
+/**
+ * Check if an executable is available in PATH, like 'which' does but without spawning it
+ */
+static bool is_in_path(const char *executable) {
+    const char *path = getenv("PATH");
+    char candidate[BUF_SIZE * 2];
+
+    if (path == NULL) {
+        return false;
+    }
+    while (*path) {
+        size_t dir_len = strcspn(path, ":");
+        if (dir_len > 0 && dir_len < BUF_SIZE) {
+            snprintf(candidate, sizeof(candidate), "%.*s/%s", (int)dir_len, path, executable);
+            if (access(candidate, X_OK) == 0) {
+                return true;
+            }
+        }
+        path += dir_len + (path[dir_len] == ':');
+    }
+
+    return false;
+}
+
+/**
+ * Run a shell pipeline that prints a number and return it, 0 on failure
+ */
+static int read_command_count(const char *command) {
+    int count = 0;
+
+    FILE *output = popen(command, "r");
+    if (output == NULL) {
+        return 0;
+    }
+    if (fscanf(output, "%d", &count) != 1) {
+        count = 0;
+    }
+    pclose(output);
+
+    return count;
+}
+
+/**
+ * Run a 'count(*)' query against a SQLite database and return its result, -1 on failure (e.g. the
+ * database is missing, locked or has another schema).
+ * The database is always opened read-only, and immutable ones are opened without taking
+ * any lock nor looking for a journal as we only need a snapshot of them.
+ *
+ * 'params' are bound in order to the query '?' parameters
+ */
+static int query_sqlite_count(const char *db_path, bool immutable, const char *query, const char **params,
+                              int params_count) {
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    char uri[BUF_SIZE];
+    int count = -1;
+
+    if (access(db_path, R_OK) != 0) {
+        return -1;
+    }
+
+    snprintf(uri, BUF_SIZE, "file:%s?mode=ro%s", db_path, immutable ? "&immutable=1" : "");
+    if (sqlite3_open_v2(uri, &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI | SQLITE_OPEN_NOMUTEX, NULL) != SQLITE_OK) {
+        log_debug("Cannot open %s: %s", db_path, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return -1;
+    }
+    if (sqlite3_prepare_v2(db, query, -1, &stmt, NULL) == SQLITE_OK) {
+        for (int i = 0; i < params_count; i++) {
+            sqlite3_bind_text(stmt, i + 1, params[i], -1, SQLITE_STATIC);
+        }
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            count = sqlite3_column_int(stmt, 0);
+        } else {
+            log_debug("Cannot query %s: %s", db_path, sqlite3_errmsg(db));
+        }
+        sqlite3_finalize(stmt);
+    } else {
+        log_debug("Cannot query %s: %s", db_path, sqlite3_errmsg(db));
+    }
+    sqlite3_close(db);
+
+    return count;
+}
+
+/**
+ * Check if a directory entry (that is not hidden) should be counted
+ */
+static bool is_countable_entry(int dirfd, const char *name, unsigned char type, bool dirs_only) {
+    if (name[0] == '.') {
+        return false;
+    }
+    if (!dirs_only) {
+        return true;
+    }
+    if (type == DT_UNKNOWN) {
+        // Some filesystems do not fill d_type so we need to ask for it
+        struct stat st;
+        return fstatat(dirfd, name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+    }
+
+    return type == DT_DIR;
+}
+
+#ifdef __linux__
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+// Called for every (non-hidden) directory entry, the entry is counted only if it returns true
+typedef bool (*dir_entry_filter)(const char *name, void *data);
+
+/**
+ * Count the (non-hidden) entries of a directory relative to 'parentfd'. If 'nested' is true then
+ * the entries of every subdirectory are counted instead, e.g. /var/db/pkg/<category>/<package>.
+ *
+ * If 'filter' is not NULL then only the entries accepted by it are counted
+ */
+static int walk_dir_entries_at(int parentfd, const char *path, bool dirs_only, bool nested, dir_entry_filter filter,
+                               void *filter_data) {
+    int count = 0;
+
+    int fd = openat(parentfd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        return 0;
+    }
+
+#ifdef __linux__
+    // getdents64 with a large buffer instead of readdir, which would only
+    // ask the kernel for a few entries on each call
+    char *buf = xmalloc(DIRENTS_BUF_SIZE);
+    long nread;
+    while ((nread = syscall(SYS_getdents64, fd, buf, DIRENTS_BUF_SIZE)) > 0) {
+        for (long pos = 0; pos < nread;) {
+            struct linux_dirent64 *entry = (struct linux_dirent64 *)(buf + pos);
+            if (is_countable_entry(fd, entry->d_name, entry->d_type, dirs_only || nested)) {
+                if (nested) {
+                    count += walk_dir_entries_at(fd, entry->d_name, dirs_only, false, filter, filter_data);
+                } else {
+                    count += filter == NULL || filter(entry->d_name, filter_data);
+                }
+            }
+            pos += entry->d_reclen;
+        }
+    }
+    xfree(buf);
+    close(fd);
+#else
+    DIR *dir = fdopendir(fd);
+    if (dir == NULL) {
+        close(fd);
+        return 0;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (is_countable_entry(fd, entry->d_name, entry->d_type, dirs_only || nested)) {
+            if (nested) {
+                count += walk_dir_entries_at(fd, entry->d_name, dirs_only, false, filter, filter_data);
+            } else {
+                count += filter == NULL || filter(entry->d_name, filter_data);
+            }
+        }
+    }
+    closedir(dir);
+#endif
+
+    return count;
+}
+
+static int count_dir_entries_at(int parentfd, const char *path, bool dirs_only, bool nested) {
+    return walk_dir_entries_at(parentfd, path, dirs_only, nested, NULL, NULL);
+}
+
+/**
+ * Count the lines of a file that start with the given prefix
+ */
+static int count_lines_with_prefix(const char *path, const char *prefix) {
+    size_t len, prefix_len = strlen(prefix);
+    int count = 0;
+
+    char *buf = map_file(path, &len);
+    if (buf == NULL) {
+        return 0;
+    }
+
+    const char *end = buf + len;
+    for (const char *line = buf; line < end;) {
+        if ((size_t)(end - line) >= prefix_len && memcmp(line, prefix, prefix_len) == 0) {
+            count++;
+        }
+        const char *newline = memchr(line, '\n', end - line);
+        if (newline == NULL) {
+            break;
+        }
+        line = newline + 1;
+    }
+    munmap(buf, len);
+
+    return count;
+}
+
+/**
+ * Count the occurrences of a string in a file
+ */
+static int count_occurrences(const char *path, const char *needle) {
+    size_t len, needle_len = strlen(needle);
+    int count = 0;
+
+    char *buf = map_file(path, &len);
+    if (buf == NULL) {
+        return 0;
+    }
+
+    const char *end = buf + len;
+    for (const char *p = buf; (p = memmem(p, end - p, needle, needle_len)) != NULL; p += needle_len) {
+        count++;
+    }
+    munmap(buf, len);
+
+    return count;
+}
+
+/**
+ * Check if the 'Status:' value that starts at the given position marks an installed package
+ */
+static bool dpkg_is_installed(const char *value, const char *end) {
+    size_t installed_len = sizeof(dpkg_installed) - 1;
+    if ((size_t)(end - value) < installed_len || memcmp(value, dpkg_installed, installed_len) != 0) {
+        return false;
+    }
+    // The value must end right there, e.g. not 'install ok installed-foo'
+    return value + installed_len == end || value[installed_len] == '\n';
+}
+
+/**
+ * Count the installed stanzas in a dpkg status database mapped in memory
+ */
+static int dpkg_count_installed(const char *buf, size_t len) {
+    const size_t key_len = sizeof(dpkg_status_key) - 1;
+    const char *end = buf + len;
+    size_t i = 0;
+    int count = 0;
+
+    // The first stanza is not preceded by a newline
+    if (len >= key_len - 1 && memcmp(buf, dpkg_status_key + 1, key_len - 1) == 0) {
+        count += dpkg_is_installed(buf + key_len - 1, end);
+    }
+
+#ifdef __SSE2__
+    // Look for the first two bytes of the key ('\n' followed by 'S') sixteen positions at a time
+    // and only compare the whole key on the candidates, which are one per line at most
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i status = _mm_set1_epi8('S');
+    for (; i + 16 < len; i += 16) {
+        __m128i first = _mm_loadu_si128((const __m128i *)(buf + i));
+        __m128i second = _mm_loadu_si128((const __m128i *)(buf + i + 1));
+        unsigned int mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, newline), _mm_cmpeq_epi8(second, status)));
+        while (mask != 0) {
+            size_t pos = i + __builtin_ctz(mask);
+            if (pos + key_len <= len && memcmp(buf + pos, dpkg_status_key, key_len) == 0) {
+                count += dpkg_is_installed(buf + pos + key_len, end);
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    // Scan the remaining bytes (or the whole buffer when SSE2 is not available), memchr
+    // is vectorized by the C library on most platforms
+    const char *p = buf + i;
+    while ((p = memchr(p, '\n', end - p)) != NULL) {
+        if ((size_t)(end - p) >= key_len && memcmp(p, dpkg_status_key, key_len) == 0) {
+            count += dpkg_is_installed(p + key_len, end);
+        }
+        p++;
+    }
+
+    return count;
+}
+
+/**
+ * Get the number of installed dpkg packages without spawning 'dpkg --list'
+ */
+static int count_dpkg_packages(void) {
+    size_t len;
+
+    char *status = map_file(DPKG_STATUS_PATH, &len);
+    if (status == NULL) {
+        return 0;
+    }
+    int count = dpkg_count_installed(status, len);
+    munmap(status, len);
+
+    return count;
+}
+
+static int count_dnf_packages(void) {
+    // Using DNF package cache is much faster than RPM
+    int count = query_sqlite_count(DNF_PACKAGES_PATH, true, "SELECT count(pkg) FROM installed", NULL, 0);
+    return count > 0 ? count : 0;
+}
+
+static int count_rpm_packages(void) {
+    // If DNF already counted the packages it makes no sense to count them again. The managers are
+    // counted at the same time so the DNF cache is queried here too, it is a single count query
+    if (count_dnf_packages() > 0) {
+        return 0;
+    }
+    // rpm >= 4.16 stores its database in SQLite, older (Berkeley DB) databases still need rpm itself
+    if (access(RPMDB_SQLITE_PATH, R_OK) == 0) {
+        int count = query_sqlite_count(RPMDB_SQLITE_PATH, true, "SELECT count(*) FROM Packages", NULL, 0);
+        return count > 0 ? count : 0;
+    }
+    if (!is_in_path("rpm")) {
+        return 0;
+    }
+    return read_command_count("rpm -qa 2> /dev/null | wc -l");
+}
+
+/**
+ * Read the memoized Nix closure size, returns -1 if the profiles generations have changed since it was stored
+ */
+static int read_nix_memo(const char *memo_path, const char *system_target, const char *user_target) {
+    char stored_system[PATH_MAX + 2], stored_user[PATH_MAX + 2];
+    int count = -1;
+
+    FILE *memo = fopen(memo_path, "r");
+    if (memo == NULL) {
+        return -1;
+    }
+    if (fgets(stored_system, sizeof(stored_system), memo) && fgets(stored_user, sizeof(stored_user), memo)) {
+        stored_system[strcspn(stored_system, "\n")] = '\0';
+        stored_user[strcspn(stored_user, "\n")] = '\0';
+        if (strcmp(stored_system, system_target) != 0 || strcmp(stored_user, user_target) != 0 ||
+            fscanf(memo, "%d", &count) != 1) {
+            count = -1;
+        }
+    }
+    fclose(memo);
+
+    return count;
+}
+
+/**
+ * Memoize the Nix closure size for the given profiles generations
+ */
+static void write_nix_memo(const char *memo_path, const char *system_target, const char *user_target, int count) {
+    char tmp_path[BUF_SIZE * 2 + 16];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d", memo_path, (int)getpid());
+
+    FILE *memo = fopen(tmp_path, "w");
+    if (memo == NULL) {
+        return;
+    }
+    fprintf(memo, "%s\n%s\n%d\n", system_target, user_target, count);
+    // Write it in a temporary file first so concurrent runs never read an incomplete memo
+    if (fclose(memo) != 0 || rename(tmp_path, memo_path) != 0) {
+        unlink(tmp_path);
+    }
+}
+
+/**
+ * Get the number of store paths in the closure of the system and user profiles by reading
+ * the Nix database directly instead of evaluating it with 'nix-store -q --requisites'
+ */
+static int count_nix_packages(void) {
+    char system_target[PATH_MAX], user_target[PATH_MAX], user_profile[PATH_MAX];
+    const char *home = getenv("HOME");
+    int count;
+
+    if (access(NIX_DB_PATH, R_OK) != 0) {
+        return 0;
+    }
+
+    // Resolve the profiles to the store paths of their current generations
+    if (realpath(NIX_SYSTEM_PROFILE_PATH, system_target) == NULL) {
+        *system_target = '\0';
+    }
+    snprintf(user_profile, PATH_MAX, "%s/.nix-profile", home != NULL ? home : "");
+    if (home == NULL || realpath(user_profile, user_target) == NULL) {
+        *user_target = '\0';
+    }
+    if (*system_target == '\0' && *user_target == '\0') {
+        return 0;
+    }
+
+    // The closure only changes when a new generation is activated
+    char *memo_path = get_cache_file_path("nix");
+    if (memo_path != NULL && (count = read_nix_memo(memo_path, system_target, user_target)) >= 0) {
+        xfree(memo_path);
+        return count;
+    }
+
+    const char *profiles[] = {system_target, user_target};
+    count = query_sqlite_count(NIX_DB_PATH, false,
+                               "WITH RECURSIVE closure(id) AS ("
+                               "  SELECT id FROM ValidPaths WHERE path IN (?1, ?2)"
+                               "  UNION"
+                               "  SELECT Refs.reference FROM Refs JOIN closure ON Refs.referrer = closure.id"
+                               ") SELECT count(*) FROM closure",
+                               profiles, 2);
+
+    // A failed query (e.g. the database is locked by nix-daemon) is not memoized, the next run retries it
+    if (memo_path != NULL) {
+        if (count >= 0) {
+            write_nix_memo(memo_path, system_target, user_target, count);
+        }
+        xfree(memo_path);
+    }
+
+    return count > 0 ? count : 0;
+}
+
+static int count_emerge_packages(void) { return count_dir_entries_at(AT_FDCWD, PORTAGE_DB_PATH, true, true); }
+
+static int count_pacman_packages(void) {
+    // Every installed package has its own directory, the database also stores an ALPM_DB_VERSION file
+    return count_dir_entries_at(AT_FDCWD, PACMAN_LOCAL_PATH, true, false);
+}
+
+/**
+ * Sorted names of every package available in the pacman sync databases
+ */
+typedef struct sync_index {
+    char **names;
+    int count;
+    int capacity;
+} sync_index;
+
+static void sync_index_add(sync_index *index, const char *name, size_t len) {
+    if (index->count == index->capacity) {
+        index->capacity = index->capacity > 0 ? index->capacity * 2 : 4096;
+        char **names = xmalloc(index->capacity * sizeof(char *));
+        if (index->names != NULL) {
+            memcpy(names, index->names, index->count * sizeof(char *));
+            xfree(index->names);
+        }
+        index->names = names;
+    }
+    char *copy = xmalloc(len + 1);
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+    index->names[index->count++] = copy;
+}
+
+static void sync_index_free(sync_index *index) {
+    for (int i = 0; i < index->count; i++) {
+        xfree(index->names[i]);
+    }
+    if (index->names != NULL) {
+        xfree(index->names);
+    }
+}
+
+static int compare_names(const void *a, const void *b) { return strcmp(*(char *const *)a, *(char *const *)b); }
+
+/**
+ * Get the length of a package name without its version, e.g. 'foo-bar-1.0-1' → 'foo-bar'.
+ * pkgver and pkgrel can not contain hyphens so we only need to drop the last two components
+ */
+static size_t pacman_name_length(const char *entry, size_t len) {
+    for (int hyphens = 0; len > 0;) {
+        if (entry[--len] == '-' && ++hyphens == 2) {
+            return len;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Add the packages names of a sync database (a tar archive, gzipped by default) to the index.
+ * Returns false if the database can not be read, e.g. when it is compressed with zstd
+ */
+static bool read_sync_database(int dirfd, const char *db_name, sync_index *index) {
+    unsigned char header[TAR_BLOCK_SIZE];
+    char last_entry[BUF_SIZE] = "";
+    bool ok = true;
+
+    int fd = openat(dirfd, db_name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    gzFile db = gzdopen(fd, "rb");
+    if (db == NULL) {
+        close(fd);
+        return false;
+    }
+    gzbuffer(db, 128 * 1024);
+
+    for (bool first = true; gzread(db, header, TAR_BLOCK_SIZE) == TAR_BLOCK_SIZE; first = false) {
+        // Two empty blocks mark the end of the archive
+        if (header[0] == '\0') {
+            break;
+        }
+        // If zlib is reading it as-is then it must be an uncompressed tar archive
+        if (first && gzdirect(db) && memcmp(header + 257, "ustar", 5) != 0) {
+            ok = false;
+            break;
+        }
+
+        // Every package is a '<name>-<pkgver>-<pkgrel>/' directory with a 'desc' file inside
+        char type = header[156];
+        size_t entry_len = strnlen((char *)header, 100);
+        entry_len = strcspn((char *)header, "/") < entry_len ? strcspn((char *)header, "/") : entry_len;
+        if ((type == '5' || type == '0' || type == '\0') && entry_len < BUF_SIZE &&
+            (strlen(last_entry) != entry_len || memcmp(last_entry, header, entry_len) != 0)) {
+            memcpy(last_entry, header, entry_len);
+            last_entry[entry_len] = '\0';
+            size_t name_len = pacman_name_length(last_entry, entry_len);
+            if (name_len > 0) {
+                sync_index_add(index, last_entry, name_len);
+            }
+        }
+
+        // Skip the entry contents, the size is stored as an octal number
+        unsigned long size = strtoul((char *)header + 124, NULL, 8);
+        if (size > 0 && gzseek(db, (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE, SEEK_CUR) == -1) {
+            ok = false;
+            break;
+        }
+    }
+    gzclose(db);
+
+    return ok;
+}
+
+/**
+ * Get the signature of every sync database, they only change after 'pacman -Sy'
+ */
+static char *get_sync_signature(void) {
+    char *signature = xmalloc(BUF_SIZE * 8);
+    size_t len = snprintf(signature, BUF_SIZE * 8, "lcfetch-sync-index %d\n", SYNC_INDEX_VERSION);
+
+    DIR *sync_dir = opendir(PACMAN_SYNC_PATH);
+    if (sync_dir == NULL) {
+        xfree(signature);
+        return NULL;
+    }
+    struct dirent *entry;
+    struct stat st;
+    while ((entry = readdir(sync_dir)) != NULL) {
+        size_t name_len = strlen(entry->d_name);
+        if (name_len < 4 || strcmp(entry->d_name + name_len - 3, ".db") != 0 ||
+            fstatat(dirfd(sync_dir), entry->d_name, &st, 0) != 0) {
+            continue;
+        }
+        len += snprintf(signature + len, BUF_SIZE * 8 - len, "%s %lld %ld %lld\n", entry->d_name,
+                        (long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec, (long long)st.st_size);
+        if (len >= BUF_SIZE * 8) {
+            // Too many sync databases to fit in the signature, do not cache them
+            closedir(sync_dir);
+            xfree(signature);
+            return NULL;
+        }
+    }
+    closedir(sync_dir);
+
+    return signature;
+}
+
+/**
+ * Build the sync index by decompressing every sync database
+ */
+static bool build_sync_index(const char *signature, sync_index *index) {
+    int dirfd = open(PACMAN_SYNC_PATH, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd == -1) {
+        return false;
+    }
+    // The signature already lists the databases names, one per line after the header
+    for (const char *line = strchr(signature, '\n') + 1; *line; line = strchr(line, '\n') + 1) {
+        char db_name[BUF_SIZE];
+        size_t name_len = strcspn(line, " ");
+        snprintf(db_name, BUF_SIZE, "%.*s", (int)name_len, line);
+        if (!read_sync_database(dirfd, db_name, index)) {
+            log_debug("Cannot read pacman sync database %s", db_name);
+            close(dirfd);
+            return false;
+        }
+    }
+    close(dirfd);
+
+    qsort(index->names, index->count, sizeof(char *), compare_names);
+    return true;
+}
+
+/**
+ * Load the cached sync index if it was built from the current sync databases
+ */
+static bool load_sync_index(const char *index_path, const char *signature, sync_index *index) {
+    size_t signature_len = strlen(signature);
+    size_t len;
+
+    char *buf = map_file(index_path, &len);
+    if (buf == NULL) {
+        return false;
+    }
+    if (len <= signature_len || memcmp(buf, signature, signature_len) != 0) {
+        munmap(buf, len);
+        return false;
+    }
+    const char *end = buf + len;
+    for (const char *name = buf + signature_len; name < end;) {
+        const char *newline = memchr(name, '\n', end - name);
+        if (newline == NULL) {
+            break;
+        }
+        sync_index_add(index, name, newline - name);
+        name = newline + 1;
+    }
+    munmap(buf, len);
+
+    return true;
+}
+
+static void store_sync_index(const char *index_path, const char *signature, sync_index *index) {
+    char tmp_path[BUF_SIZE * 2 + 16];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d", index_path, (int)getpid());
+
+    FILE *cache = fopen(tmp_path, "w");
+    if (cache == NULL) {
+        return;
+    }
+    fputs(signature, cache);
+    for (int i = 0; i < index->count; i++) {
+        // Several databases can provide the same package
+        if (i == 0 || strcmp(index->names[i], index->names[i - 1]) != 0) {
+            fprintf(cache, "%s\n", index->names[i]);
+        }
+    }
+    if (fclose(cache) != 0 || rename(tmp_path, index_path) != 0) {
+        unlink(tmp_path);
+    }
+}
+
+/**
+ * Check if a local package directory belongs to a package that is not in the sync databases
+ */
+static bool is_foreign_package(const char *entry, void *data) {
+    sync_index *index = data;
+    char name[BUF_SIZE];
+
+    size_t name_len = pacman_name_length(entry, strlen(entry));
+    if (name_len == 0 || name_len >= BUF_SIZE) {
+        return false;
+    }
+    memcpy(name, entry, name_len);
+    name[name_len] = '\0';
+
+    const char *key = name;
+    return bsearch(&key, index->names, index->count, sizeof(char *), compare_names) == NULL;
+}
+
+/**
+ * Get the number of foreign (e.g. AUR) packages, like 'pacman -Qqm' does but without decompressing
+ * the sync databases on every run. Their packages names are cached in a sorted index that is
+ * only rebuilt when the sync databases change
+ */
+static int count_aur_packages(void) {
+    sync_index index = {NULL, 0, 0};
+    int count = 0;
+
+    if (access(PACMAN_LOCAL_PATH, F_OK) != 0) {
+        return 0;
+    }
+
+    char *signature = get_sync_signature();
+    char *index_path = get_cache_file_path("pacman-sync");
+    bool loaded = signature != NULL && index_path != NULL && load_sync_index(index_path, signature, &index);
+    if (!loaded && signature != NULL && build_sync_index(signature, &index)) {
+        loaded = true;
+        if (index_path != NULL) {
+            store_sync_index(index_path, signature, &index);
+        }
+    }
+
+    if (loaded) {
+        count = walk_dir_entries_at(AT_FDCWD, PACMAN_LOCAL_PATH, true, false, is_foreign_package, &index);
+    } else if (is_in_path("pacman")) {
+        // e.g. zstd compressed databases, let pacman do the work
+        count = read_command_count("pacman -Qqm 2> /dev/null | wc -l");
+    }
+
+    sync_index_free(&index);
+    if (signature != NULL) {
+        xfree(signature);
+    }
+    if (index_path != NULL) {
+        xfree(index_path);
+    }
+
+    return count;
+}
+
+static int count_apk_packages(void) {
+    // Every package stanza in the installed database starts with its name
+    return count_lines_with_prefix(APK_INSTALLED_PATH, "P:");
+}
+
+static int count_xbps_packages(void) {
+    // Every package dictionary in the pkgdb has its own pkgver key
+    return count_occurrences(XBPS_PKGDB_PATH, "<key>pkgver</key>");
+}
+
+static int count_flatpak_packages(void) {
+    // NOTE: it seems that flatpak does not like to be called from a popen so it fails in
+    // a really stupid way sending a non-sense error, this is why we are not using 'flatpak list'
+    return count_dir_entries_at(AT_FDCWD, FLATPAK_APP_PATH, false, false) +
+           count_dir_entries_at(AT_FDCWD, FLATPAK_RUNTIME_PATH, false, false);
+}
+
+// Supported package managers, in the same order they are displayed. The sources are the
+// files or directories that change when packages are installed or removed
+static const package_manager package_managers[] = {
+    {"dpkg", count_dpkg_packages, {DPKG_STATUS_PATH}, 0},
+    {"dnf", count_dnf_packages, {DNF_PACKAGES_PATH}, 0},
+    {"rpm", count_rpm_packages, {RPMDB_SQLITE_PATH, "/var/lib/rpm"}, 0},
+    {"nix", count_nix_packages, {NIX_SYSTEM_PROFILE_PATH, "~/.nix-profile"}, 0},
+    {"emerge", count_emerge_packages, {PORTAGE_DB_PATH, "/var/cache/edb/counter"}, 0},
+    {"pacman", count_pacman_packages, {PACMAN_LOCAL_PATH}, 0},
+    {"AUR", count_aur_packages, {PACMAN_LOCAL_PATH, PACMAN_SYNC_PATH}, 0},
+    {"apk", count_apk_packages, {APK_INSTALLED_PATH}, 0},
+    {"xbps-query", count_xbps_packages, {XBPS_PKGDB_PATH}, 0},
+    {"flatpak", count_flatpak_packages, {FLATPAK_APP_PATH, FLATPAK_RUNTIME_PATH}, 0},
+};
+
+static void *package_manager_worker(void *arg) {
+    package_manager *manager = arg;
+    manager->packages = manager->count();
+
+    return NULL;
+}
+
+/**
+ * Count the installed packages of every supported package manager. The package managers are
+ * independent so they are scanned at the same time, and the total cost is the slowest one.
+ *
+ * Returns a copy of the package managers with their counts, allocated in the arena
+ */
+package_manager *count_packages(int *managers_count) {
+    pthread_t workers[COUNT(package_managers)];
+    bool started[COUNT(package_managers)];
+    package_manager *managers = arena_alloc(sizeof(package_managers));
+    memcpy(managers, package_managers, sizeof(package_managers));
+
+    for (int i = 0; i < COUNT(package_managers); i++) {
+        started[i] = pthread_create(&workers[i], NULL, package_manager_worker, &managers[i]) == 0;
+        // If we are not able to spawn a new thread then let's count them here
+        if (!started[i]) {
+            package_manager_worker(&managers[i]);
+        }
+    }
+    for (int i = 0; i < COUNT(package_managers); i++) {
+        if (started[i]) {
+            pthread_join(workers[i], NULL);
+        }
+    }
+
+    *managers_count = COUNT(package_managers);
+    return managers;
+}
+
+/**
+ * Get the package managers sources, e.g. for knowing when their packages count may have changed
+ */
+int get_package_sources(const char **sources, int max_sources) {
+    int sources_count = 0;
+
+    for (int i = 0; i < COUNT(package_managers); i++) {
+        for (int j = 0; j < MAX_PACKAGE_SOURCES && package_managers[i].sources[j] != NULL; j++) {
+            if (sources_count < max_sources) {
+                sources[sources_count++] = package_managers[i].sources[j];
+            }
+        }
+    }
+
+    return sources_count;
+}
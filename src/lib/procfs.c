@@ -0,0 +1,394 @@
+/* C stdlib */
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+/* Custom headers */
+#include "lcfetch.h"
+
+// The registry grows as needed, this is only its initial capacity
+#define PSEUDO_FILES_CAPACITY 16
+// Maximum number of files read in a single io_uring batch, the rest are read on demand
+#define MAX_PREFETCH_FILES 32
+// Slots of every key index, the pseudo-files have less than a hundred distinct keys
+#define INDEX_SLOTS 256
+
+/**
+ * A key of a pseudo-file, e.g. 'MemTotal' in /proc/meminfo, with its first value and
+ * the number of times it appears (e.g. 'processor' in /proc/cpuinfo appears once per CPU).
+ * Both are stored as offsets into the pseudo-file buffer
+ */
+typedef struct pseudo_key {
+    uint32_t key_offset;
+    uint32_t key_len;
+    uint32_t value_offset;
+    uint32_t value_len;
+    int count;
+} pseudo_key;
+
+/**
+ * A procfs, sysfs or small configuration file (e.g. /etc/os-release) read with a single read() into
+ * a buffer that is reused every time the file is loaded again, and its 'key : value' index built on
+ * the first lookup
+ */
+typedef struct pseudo_file {
+    char *path;
+    char *buf;
+    size_t buf_size;
+    size_t len;
+    bool loaded;
+    // Loaded by prefetch_pseudo_files and not used yet
+    bool prefetched;
+    // Only the beginning of the file was read, see load_pseudo_file_head
+    bool truncated;
+    bool indexed;
+    char separator;
+    pseudo_key index[INDEX_SLOTS];
+} pseudo_file;
+
+// Every entry is allocated on its own so they do not move when the registry grows
+static pseudo_file **pseudo_files = NULL;
+static int pseudo_files_count = 0;
+static int pseudo_files_capacity = 0;
+// The collectors run on several threads
+static pthread_mutex_t pseudo_files_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t hash_key(const char *key, size_t len) {
+    // FNV-1a hash
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Find the index slot of a key, which is empty if the key is not indexed
+ */
+static pseudo_key *find_key_slot(pseudo_file *file, const char *key, size_t key_len) {
+    uint32_t slot = hash_key(key, key_len) & (INDEX_SLOTS - 1);
+
+    for (int probes = 0; probes < INDEX_SLOTS; probes++, slot = (slot + 1) & (INDEX_SLOTS - 1)) {
+        pseudo_key *entry = &file->index[slot];
+        if (entry->count == 0 ||
+            (entry->key_len == key_len && memcmp(file->buf + entry->key_offset, key, key_len) == 0)) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Index every 'key : value' (or 'key=value') line, the whitespaces around the separator
+ * are not part of the key nor the value. The separator is the first one found in the file
+ */
+static void index_pseudo_file(pseudo_file *file) {
+    memset(file->index, 0, sizeof(file->index));
+    file->indexed = true;
+    file->separator = '\0';
+
+    for (size_t line = 0, line_end; line < file->len; line = line_end + 1) {
+        const char *newline = memchr(file->buf + line, '\n', file->len - line);
+        line_end = newline != NULL ? (size_t)(newline - file->buf) : file->len;
+        // The last line of a truncated file can be incomplete
+        if (newline == NULL && file->truncated) {
+            break;
+        }
+        if (file->buf[line] == '#') {
+            continue;
+        }
+        if (file->separator == '\0') {
+            size_t separator_offset = line + strcspn(file->buf + line, ":=\n");
+            if (separator_offset >= line_end) {
+                continue;
+            }
+            file->separator = file->buf[separator_offset];
+        }
+        const char *separator = memchr(file->buf + line, file->separator, line_end - line);
+        if (separator == NULL) {
+            continue;
+        }
+
+        size_t key_end = separator - file->buf;
+        while (key_end > line && (file->buf[key_end - 1] == ' ' || file->buf[key_end - 1] == '\t')) {
+            key_end--;
+        }
+        size_t value = separator - file->buf + 1;
+        while (value < line_end && (file->buf[value] == ' ' || file->buf[value] == '\t')) {
+            value++;
+        }
+
+        pseudo_key *entry = find_key_slot(file, file->buf + line, key_end - line);
+        if (entry == NULL) {
+            continue;
+        }
+        if (entry->count++ == 0) {
+            *entry = (pseudo_key){line, key_end - line, value, line_end - value, 1};
+        }
+    }
+}
+
+/**
+ * Get the registry entry of a pseudo-file, it is added if needed. Must be called with the
+ * registry locked
+ */
+static pseudo_file *get_pseudo_file(const char *path) {
+    for (int i = 0; i < pseudo_files_count; i++) {
+        if (strcmp(pseudo_files[i]->path, path) == 0) {
+            return pseudo_files[i];
+        }
+    }
+    if (pseudo_files_count == pseudo_files_capacity) {
+        int capacity = pseudo_files_capacity > 0 ? pseudo_files_capacity * 2 : PSEUDO_FILES_CAPACITY;
+        pseudo_file **bigger_pseudo_files = xmalloc(capacity * sizeof(pseudo_file *));
+        if (pseudo_files != NULL) {
+            memcpy(bigger_pseudo_files, pseudo_files, pseudo_files_count * sizeof(pseudo_file *));
+            xfree(pseudo_files);
+        }
+        pseudo_files = bigger_pseudo_files;
+        pseudo_files_capacity = capacity;
+    }
+
+    pseudo_file *file = xmalloc(sizeof(pseudo_file));
+    memset(file, 0, sizeof(*file));
+    file->path = xstrdup(path);
+    pseudo_files[pseudo_files_count++] = file;
+
+    return file;
+}
+
+/**
+ * Read a pseudo-file into its buffer, their size is unknown (stat reports 0 or 4096)
+ * so the buffer grows until the whole file fits in a single read
+ */
+static bool read_into_buffer(pseudo_file *file) {
+    file->loaded = file->prefetched = file->truncated = file->indexed = false;
+    file->len = 0;
+
+    int fd = open(file->path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    if (file->buf == NULL) {
+        file->buf_size = BUF_SIZE * 16;
+        file->buf = xmalloc(file->buf_size);
+    }
+
+    ssize_t nread;
+    while ((nread = pread(fd, file->buf, file->buf_size, 0)) == (ssize_t)file->buf_size) {
+        xfree(file->buf);
+        file->buf_size *= 2;
+        file->buf = xmalloc(file->buf_size);
+    }
+    close(fd);
+    if (nread < 0) {
+        return false;
+    }
+    file->len = nread;
+    file->loaded = true;
+
+    return true;
+}
+
+/**
+ * Read a pseudo-file again, e.g. /proc/meminfo every time the memory is collected, unless it
+ * was just prefetched. Returns false if it can not be read
+ */
+bool load_pseudo_file(const char *path) {
+    pthread_mutex_lock(&pseudo_files_lock);
+    pseudo_file *file = get_pseudo_file(path);
+    bool loaded = (file->prefetched && !file->truncated) || read_into_buffer(file);
+    if (loaded) {
+        file->prefetched = false;
+    }
+    pthread_mutex_unlock(&pseudo_files_lock);
+
+    return loaded;
+}
+
+/**
+ * Read only the first 'size' bytes of a pseudo-file, e.g. the first processor of /proc/cpuinfo.
+ * The kernel generates some pseudo-files as they are read, so this takes the same time no
+ * matter how big the whole file is. Returns false if it can not be read
+ */
+bool load_pseudo_file_head(const char *path, size_t size) {
+    bool loaded = false;
+
+    pthread_mutex_lock(&pseudo_files_lock);
+    pseudo_file *file = get_pseudo_file(path);
+    if (file->prefetched) {
+        // The prefetched contents are enough, whether they are the whole file or not
+        file->prefetched = false;
+        loaded = true;
+    } else {
+        file->loaded = file->prefetched = file->indexed = false;
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd != -1) {
+            if (file->buf == NULL || file->buf_size < size) {
+                if (file->buf != NULL) {
+                    xfree(file->buf);
+                }
+                file->buf_size = size;
+                file->buf = xmalloc(file->buf_size);
+            }
+            ssize_t nread = pread(fd, file->buf, size, 0);
+            close(fd);
+            if (nread >= 0) {
+                file->len = nread;
+                file->truncated = (size_t)nread == size;
+                file->loaded = loaded = true;
+            }
+        }
+    }
+    pthread_mutex_unlock(&pseudo_files_lock);
+
+    return loaded;
+}
+
+/**
+ * Read several pseudo-files at once with io_uring before the collectors need them, the
+ * next load_pseudo_file of every one of them uses the prefetched contents. Nothing is
+ * read if io_uring is not available, the collectors read them on their own then
+ */
+void prefetch_pseudo_files(const char **paths, int count) {
+    const char *batch_paths[MAX_PREFETCH_FILES];
+    char *bufs[MAX_PREFETCH_FILES];
+    size_t sizes[MAX_PREFETCH_FILES];
+    ssize_t lens[MAX_PREFETCH_FILES];
+    pseudo_file *batch_files[MAX_PREFETCH_FILES];
+    int batch_count = 0;
+
+    pthread_mutex_lock(&pseudo_files_lock);
+    for (int i = 0; i < count && batch_count < MAX_PREFETCH_FILES; i++) {
+        pseudo_file *file = get_pseudo_file(paths[i]);
+        if (file->prefetched) {
+            continue;
+        }
+        if (file->buf == NULL) {
+            file->buf_size = BUF_SIZE * 16;
+            file->buf = xmalloc(file->buf_size);
+        }
+        batch_files[batch_count] = file;
+        batch_paths[batch_count] = file->path;
+        bufs[batch_count] = file->buf;
+        sizes[batch_count] = file->buf_size;
+        batch_count++;
+    }
+
+    if (batch_count > 0 && read_files_batch(batch_paths, bufs, sizes, lens, batch_count)) {
+        for (int i = 0; i < batch_count; i++) {
+            pseudo_file *file = batch_files[i];
+            // A full buffer could be a truncated file, it is read again with a bigger buffer
+            // unless only its beginning is needed
+            if (lens[i] >= 0) {
+                file->len = lens[i];
+                file->truncated = (size_t)lens[i] == file->buf_size;
+                file->loaded = file->prefetched = true;
+                file->indexed = false;
+            }
+        }
+    }
+    pthread_mutex_unlock(&pseudo_files_lock);
+}
+
+/**
+ * Get a loaded and indexed pseudo-file, it is read if it was not read yet.
+ * Must be called with the registry locked
+ */
+static pseudo_file *get_indexed_pseudo_file(const char *path) {
+    pseudo_file *file = get_pseudo_file(path);
+    if (!file->loaded && !read_into_buffer(file)) {
+        return NULL;
+    }
+    if (!file->indexed) {
+        index_pseudo_file(file);
+    }
+
+    return file;
+}
+
+/**
+ * Copy the first value of a key in a pseudo-file, e.g. 'model name' in /proc/cpuinfo.
+ * Returns false if the file can not be read or the key does not exist
+ */
+bool get_pseudo_file_value(const char *path, const char *key, char *value, size_t size) {
+    bool found = false;
+
+    pthread_mutex_lock(&pseudo_files_lock);
+    pseudo_file *file = get_indexed_pseudo_file(path);
+    pseudo_key *entry = file != NULL ? find_key_slot(file, key, strlen(key)) : NULL;
+    if (entry != NULL && entry->count > 0) {
+        size_t len = entry->value_len < size - 1 ? entry->value_len : size - 1;
+        memcpy(value, file->buf + entry->value_offset, len);
+        value[len] = '\0';
+        found = true;
+    }
+    pthread_mutex_unlock(&pseudo_files_lock);
+
+    return found;
+}
+
+/**
+ * Count the lines of a pseudo-file with the given key, e.g. 'processor' in /proc/cpuinfo
+ */
+int count_pseudo_file_key(const char *path, const char *key) {
+    int count = 0;
+
+    pthread_mutex_lock(&pseudo_files_lock);
+    pseudo_file *file = get_indexed_pseudo_file(path);
+    pseudo_key *entry = file != NULL ? find_key_slot(file, key, strlen(key)) : NULL;
+    if (entry != NULL) {
+        count = entry->count;
+    }
+    pthread_mutex_unlock(&pseudo_files_lock);
+
+    return count;
+}
+
+/**
+ * Copy the first line of a single value pseudo-file, e.g. /sys/devices/system/cpu/present.
+ * It is read again every time (CPUs can be hotplugged while --daemon or --watch run) unless
+ * it was just prefetched. Returns false if it can not be read
+ */
+bool read_pseudo_file(const char *path, char *content, size_t size) {
+    bool found = false;
+
+    pthread_mutex_lock(&pseudo_files_lock);
+    pseudo_file *file = get_pseudo_file(path);
+    if ((file->prefetched && !file->truncated) || read_into_buffer(file)) {
+        file->prefetched = false;
+        const char *newline = memchr(file->buf, '\n', file->len);
+        size_t len = newline != NULL ? (size_t)(newline - file->buf) : file->len;
+        len = len < size - 1 ? len : size - 1;
+        memcpy(content, file->buf, len);
+        content[len] = '\0';
+        found = true;
+    }
+    pthread_mutex_unlock(&pseudo_files_lock);
+
+    return found;
+}
+
+/**
+ * Release every pseudo-file buffer
+ */
+void free_pseudo_files(void) {
+    pthread_mutex_lock(&pseudo_files_lock);
+    for (int i = 0; i < pseudo_files_count; i++) {
+        xfree(pseudo_files[i]->path);
+        if (pseudo_files[i]->buf != NULL) {
+            xfree(pseudo_files[i]->buf);
+        }
+        xfree(pseudo_files[i]);
+    }
+    if (pseudo_files != NULL) {
+        xfree(pseudo_files);
+        pseudo_files = NULL;
+    }
+    pseudo_files_count = pseudo_files_capacity = 0;
+    pthread_mutex_unlock(&pseudo_files_lock);
+}
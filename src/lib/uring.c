@@ -0,0 +1,195 @@
+/* C stdlib */
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#ifdef USE_IO_URING
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+/* Custom headers */
+#include "lcfetch.h"
+
+#ifdef USE_IO_URING
+/**
+ * Submission and completion rings mapped from the kernel, liburing is not needed
+ * for the few operations we use
+ */
+typedef struct uring {
+    int fd;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_size;
+    size_t cq_size;
+    size_t sqes_size;
+} uring;
+
+static bool setup_uring(uring *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+
+    // It can be unavailable on old kernels or disabled by the system (or a seccomp filter)
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        return false;
+    }
+
+    ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->sq_size = ring->cq_size = ring->sq_size > ring->cq_size ? ring->sq_size : ring->cq_size;
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                        IORING_OFF_SQ_RING);
+    ring->cq_ptr = (params.features & IORING_FEAT_SINGLE_MMAP)
+                       ? ring->sq_ptr
+                       : mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                              IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                      IORING_OFF_SQES);
+    if (ring->sq_ptr == MAP_FAILED || ring->cq_ptr == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        close(ring->fd);
+        return false;
+    }
+
+    ring->sq_tail = (unsigned *)((char *)ring->sq_ptr + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)((char *)ring->sq_ptr + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)((char *)ring->sq_ptr + params.sq_off.array);
+    ring->cq_head = (unsigned *)((char *)ring->cq_ptr + params.cq_off.head);
+    ring->cq_tail = (unsigned *)((char *)ring->cq_ptr + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)((char *)ring->cq_ptr + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ptr + params.cq_off.cqes);
+
+    return true;
+}
+
+static void close_uring(uring *ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_size);
+    }
+    munmap(ring->sq_ptr, ring->sq_size);
+    close(ring->fd);
+}
+
+/**
+ * Get the next submission entry, they are submitted all together by submit_and_wait
+ */
+static struct io_uring_sqe *get_sqe(uring *ring, unsigned queued) {
+    unsigned index = (*ring->sq_tail + queued) & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+
+    return sqe;
+}
+
+/**
+ * Submit the queued entries and wait for all of them, 'results' is indexed by user_data
+ */
+static bool submit_and_wait(uring *ring, unsigned queued, int *results) {
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + queued, __ATOMIC_RELEASE);
+
+    unsigned to_submit = queued;
+    for (unsigned completed = 0; completed < queued;) {
+        int submitted = syscall(__NR_io_uring_enter, ring->fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (submitted < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        to_submit -= (unsigned)submitted < to_submit ? (unsigned)submitted : to_submit;
+
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++, completed++) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            results[cqe->user_data] = cqe->res;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    return true;
+}
+#endif
+
+/**
+ * Read a batch of files with io_uring: all the opens are submitted at once and then all the
+ * reads, so the waits for every file overlap. Every file is read into bufs[i] up to sizes[i]
+ * bytes, lens[i] is set to the bytes read or a negative errno if it failed.
+ *
+ * Returns false if io_uring is not available (or lcfetch was built without it), then nothing
+ * was read and the files must be read with read()
+ */
+bool read_files_batch(const char **paths, char **bufs, const size_t *sizes, ssize_t *lens, int count) {
+#ifdef USE_IO_URING
+    uring ring;
+    int fds[count];
+    int results[count];
+
+    if (count <= 0 || !setup_uring(&ring, count)) {
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        struct io_uring_sqe *sqe = get_sqe(&ring, i);
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (unsigned long)paths[i];
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        sqe->user_data = i;
+    }
+    if (!submit_and_wait(&ring, count, fds)) {
+        close_uring(&ring);
+        return false;
+    }
+
+    int reads = 0;
+    for (int i = 0; i < count; i++) {
+        lens[i] = fds[i];
+        if (fds[i] >= 0) {
+            struct io_uring_sqe *sqe = get_sqe(&ring, reads++);
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fds[i];
+            sqe->addr = (unsigned long)bufs[i];
+            sqe->len = sizes[i];
+            sqe->user_data = i;
+        }
+    }
+    bool done = reads == 0 || submit_and_wait(&ring, reads, results);
+    for (int i = 0; i < count; i++) {
+        if (fds[i] >= 0) {
+            lens[i] = done ? results[i] : -EIO;
+            close(fds[i]);
+        }
+    }
+    close_uring(&ring);
+
+    return true;
+#else
+    (void)paths;
+    (void)bufs;
+    (void)sizes;
+    (void)lens;
+    (void)count;
+
+    return false;
+#endif
+}
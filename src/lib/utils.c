@@ -2,11 +2,13 @@
 #include <ctype.h>
 #include <dirent.h>
 #include <log.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/stat.h>
 /* ASCII logos */
 #include "logos/android.h"
 #include "logos/arch.h"
@@ -33,7 +35,7 @@ char *repeat_string(char *str, int times) {
         return str;
     }
 
-    char *result = xmalloc(BUF_SIZE);
+    char *result = arena_alloc(BUF_SIZE);
     char *repeated = result;
 
     for (int i = 0; i < times; i++) {
@@ -65,61 +67,142 @@ void truncate_whitespaces(char *str) {
     *(str + src) = '\0';
 }
 
-char *remove_substr(char *str, const char *sub) {
-    char *p, *q, *r;
+/**
+ * Create an empty string builder, its string is allocated in the arena and grows as needed
+ */
+strbuf sb_new(size_t capacity) {
+    strbuf sb = {arena_alloc(capacity + 1), 0, capacity};
+    *sb.str = '\0';
 
-    if (*sub && (q = r = strstr(str, sub)) != NULL) {
-        size_t len = strlen(sub);
-        while ((r = strstr(p = r + len, sub)) != NULL) {
-            while (p < r) {
-                *q++ = *p++;
-            }
-        }
-        while ((*q++ = *p++) != '\0') {
-            continue;
-        }
+    return sb;
+}
+
+/**
+ * Make room for 'extra' more characters (without counting the null terminator)
+ */
+static void sb_grow(strbuf *sb, size_t extra) {
+    if (sb->len + extra <= sb->capacity) {
+        return;
     }
-    return str;
+    size_t capacity = sb->capacity * 2 > sb->len + extra ? sb->capacity * 2 : sb->len + extra;
+    char *str = arena_alloc(capacity + 1);
+    memcpy(str, sb->str, sb->len + 1);
+    sb->str = str;
+    sb->capacity = capacity;
 }
 
-char *replace_string(char *str, char *pattern, char *new_pattern) {
-    char *new_str;
-    int i = 0, count = 0;
-    int pattern_len = strlen(pattern);
-    int new_pattern_len = strlen(new_pattern);
+void sb_append(strbuf *sb, const char *str) { sb_append_len(sb, str, strlen(str)); }
 
-    // Count the number of times old pattern occurs in the string
-    for (i = 0; str[i] != '\0'; i++) {
-        if (strstr(&str[i], pattern) == &str[i]) {
-            count++;
+void sb_append_len(strbuf *sb, const char *str, size_t len) {
+    sb_grow(sb, len);
+    memcpy(sb->str + sb->len, str, len);
+    sb->len += len;
+    sb->str[sb->len] = '\0';
+}
 
-            i += pattern_len - 1;
-        }
+void sb_appendf(strbuf *sb, const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(sb->str + sb->len, sb->capacity - sb->len + 1, format, args);
+    va_end(args);
+    if (len < 0) {
+        sb->str[sb->len] = '\0';
+        return;
     }
-    new_str = xmalloc(i + count * (new_pattern_len - pattern_len) + 1);
-
-    i = 0;
-    while (*str) {
-        // Compare the substrings with our result
-        if (strstr(str, pattern) == str) {
-            strcpy(&new_str[i], new_pattern);
-            i += new_pattern_len;
-            str += pattern_len;
-        } else {
-            new_str[i++] = *str++;
-        }
+    // It did not fit, grow it and format it again
+    if ((size_t)len > sb->capacity - sb->len) {
+        sb_grow(sb, len);
+        va_start(args, format);
+        vsnprintf(sb->str + sb->len, len + 1, format, args);
+        va_end(args);
+    }
+    sb->len += len;
+}
+
+/**
+ * Replace every occurrence of 'pattern' in a single pass. Returns the number of replacements
+ */
+int sb_replace_all(strbuf *sb, const char *pattern, const char *replacement) {
+    size_t pattern_len = strlen(pattern);
+    if (pattern_len == 0 || strstr(sb->str, pattern) == NULL) {
+        return 0;
+    }
+
+    int count = 0;
+    strbuf replaced = sb_new(sb->len);
+    char *str = sb->str;
+    for (char *match; (match = strstr(str, pattern)) != NULL; str = match + pattern_len) {
+        sb_append_len(&replaced, str, match - str);
+        sb_append(&replaced, replacement);
+        count++;
     }
+    sb_append_len(&replaced, str, sb->len - (str - sb->str));
+    *sb = replaced;
 
-    new_str[i] = '\0';
-    return new_str;
+    return count;
 }
 
-char *str_to_lower(char *str) {
-    for (char *c = str; *c; c++) {
-        *c = tolower(*c);
+/**
+ * Get the path of a file inside the lcfetch cache directory (creating the directory if needed),
+ * e.g. /home/user/.cache/lcfetch/<name>. Returns NULL if there is no cache directory available or
+ * the path is too long
+ */
+char *get_cache_file_path(const char *name) {
+    const char *xdg_cache_home = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    const char *cache_home;
+    const char *cache_home_suffix;
+
+    if (xdg_cache_home != NULL && *xdg_cache_home == '/') {
+        cache_home = xdg_cache_home;
+        cache_home_suffix = "";
+    } else if (home != NULL) {
+        cache_home = home;
+        cache_home_suffix = "/.cache";
+    } else {
+        return NULL;
     }
 
-    return str;
+    char *cache_file_path = xmalloc(BUF_SIZE * 2);
+    int len = snprintf(cache_file_path, BUF_SIZE * 2, "%s%s/lcfetch/%s", cache_home, cache_home_suffix, name);
+    if (len < 0 || len >= BUF_SIZE * 2) {
+        xfree(cache_file_path);
+        return NULL;
+    }
+
+    // Create the cache directories by cutting the path at their separators, the parent one could
+    // not exist yet in some minimal systems
+    char *cache_directory_end = cache_file_path + len - strlen(name) - 1;
+    *cache_directory_end = '\0';
+    char *cache_home_end = strrchr(cache_file_path, '/');
+    *cache_home_end = '\0';
+    mkdir(cache_file_path, 0700);
+    *cache_home_end = '/';
+    mkdir(cache_file_path, 0700);
+    *cache_directory_end = '/';
+
+    return cache_file_path;
+}
+
+/**
+ * Get the path of a file inside $XDG_RUNTIME_DIR, e.g. /run/user/1000/<name>, or inside the
+ * cache directory if there is no runtime directory. Returns NULL if there is none of them
+ */
+char *get_runtime_file_path(const char *name) {
+    const char *xdg_runtime_dir = getenv("XDG_RUNTIME_DIR");
+
+    if (xdg_runtime_dir == NULL || *xdg_runtime_dir != '/') {
+        return get_cache_file_path(name);
+    }
+    char *runtime_file_path = xmalloc(BUF_SIZE * 2);
+    int len = snprintf(runtime_file_path, BUF_SIZE * 2, "%s/%s", xdg_runtime_dir, name);
+    if (len < 0 || len >= BUF_SIZE * 2) {
+        xfree(runtime_file_path);
+        return NULL;
+    }
+
+    return runtime_file_path;
 }
 
 bool is_android_device() {
@@ -184,7 +267,7 @@ int get_distro_logo_rows(char *distro) {
 }
 
 char *get_distro_accent(char *distro) {
-    char *accent_color = xmalloc(BUF_SIZE);
+    char *accent_color = arena_alloc(BUF_SIZE);
     if ((strcasecmp(distro, "fedora") == 0) || (strstr(distro, "Fedora"))) {
         strncpy(accent_color, fedora_accent, BUF_SIZE);
     } else if (strcasecmp(distro, "gentoo") == 0) {
@@ -219,7 +302,7 @@ char *get_custom_accent(char *color) {
      * cyan   = 6
      * white  = 7
      * */
-    char *accent_color = xmalloc(BUF_SIZE);
+    char *accent_color = arena_alloc(BUF_SIZE);
     if (strcasecmp(color, "black") == 0) {
         strncpy(accent_color, "\e[1;30m", BUF_SIZE);
     } else if (strcasecmp(color, "red") == 0) {
@@ -244,31 +327,29 @@ custom_ascii_logo get_custom_logo() {
     // NOTE: the current colors implementation is very tricky, should have a refactor later
     char *colors[] = {"black", "red", "green", "yellow", "blue", "purple", "cyan", "white"};
     bool has_accent = false;
-    const char *custom_accent_color = get_option_string("accent_color");
+    const char *custom_accent_color = options.accent_color;
 
     custom_ascii_logo logo;
-    int custom_logo_size = get_table_size("custom_ascii_logo");
+    int custom_logo_size = options.custom_ascii_logo_size;
     if (custom_logo_size > 0) {
         logo.cols = custom_logo_size;
-        logo.arr = (char **)xmalloc(BUF_SIZE * logo.cols);
+        logo.arr = arena_alloc(logo.cols * sizeof(char *));
         for (int i = 1; i <= custom_logo_size; i++) {
-            char *logo_line = (char *)get_subtable_string("custom_ascii_logo", i);
+            const char *logo_line = options.custom_ascii_logo[i - 1];
             if (strlen(custom_accent_color) > 0) {
                 char *accent_color = get_custom_accent((char *)custom_accent_color);
-                char *logo_line_fmt = xmalloc(BUF_SIZE);
+                char *logo_line_fmt = arena_alloc(BUF_SIZE);
                 snprintf(logo_line_fmt, BUF_SIZE, "%s%s", accent_color, logo_line);
                 logo.arr[i - 1] = logo_line_fmt;
-                xfree(accent_color);
                 has_accent = true;
             } else {
                 // Iterate over all possible colors and replace them
                 for (int j = 0; j < LEN(colors); j++) {
-                    char *accent_color = get_custom_accent(colors[j]);
-                    char *logo_line_fmt = replace_string(logo_line, colors[j], accent_color);
-                    logo.arr[i - 1] = logo_line_fmt;
-                    unsigned long logo_fmt_len = strlen(logo_line_fmt);
-                    xfree(accent_color);
-                    if (strlen(logo_line) != logo_fmt_len) {
+                    strbuf logo_line_fmt = sb_new(strlen(logo_line));
+                    sb_append(&logo_line_fmt, logo_line);
+                    int replaced = sb_replace_all(&logo_line_fmt, colors[j], get_custom_accent(colors[j]));
+                    logo.arr[i - 1] = logo_line_fmt.str;
+                    if (replaced > 0) {
                         has_accent = true;
                         break;
                     }
@@ -289,101 +370,63 @@ void print_colors(char *logo_part, char *next_logo_part, char *gap_logo, char *g
     char *bright_colors = get_colors_bright();
     // if we should add padding instead of the next distro logo line
     if ((strlen(logo_part) == 0) || (strlen(logo_part) - strlen("\e[1;00m") == 0)) {
-        printf("%s%s%s\n", gap_logo, gap_info, dark_colors);
+        frame_append(gap_logo);
     } else {
-        printf("%s%s%s\n", logo_part, gap_info, dark_colors);
+        frame_append(logo_part);
     }
+    frame_append(gap_info);
+    frame_append(dark_colors);
+    frame_append("\n");
     if ((strlen(next_logo_part) == 0) || (strlen(next_logo_part) - strlen("\e[1;00m") == 0)) {
-        printf("%s%s%s\n", gap_logo, gap_info, bright_colors);
+        frame_append(gap_logo);
     } else {
-        printf("%s%s%s\n", next_logo_part, gap_info, bright_colors);
+        frame_append(next_logo_part);
     }
-    xfree(dark_colors);
-    xfree(bright_colors);
+    frame_append(gap_info);
+    frame_append(bright_colors);
+    frame_append("\n");
 }
 
-void print_field(char *logo_part, char *gap, const char *delimiter, char *accent, const char *field_name) {
+void print_field(char *logo_part, char *gap, const char *delimiter, char *accent, field_kind kind, char *value) {
     // NOTE: colors field requires a special treatment so we don't use print_info on it
 
     // User information requires a special treatment
     bool is_user_title = false;
     bool is_separator = false;
 
-    char *message = xmalloc(BUF_SIZE);
-    // Set the function that will be used for getting the field value
-    char *field_function = NULL;
-    char *field_message = xmalloc(BUF_SIZE);
-
-    // Get the fields data
-    if (strcasecmp(field_name, "os") == 0) {
-        field_function = get_os(1);
-    } else if (strcasecmp(field_name, "kernel") == 0) {
-        field_function = get_kernel();
-    } else if (strcasecmp(field_name, "uptime") == 0) {
-        field_function = get_uptime();
-    } else if (strcasecmp(field_name, "packages") == 0) {
-        field_function = get_packages();
-    } else if (strcasecmp(field_name, "wm") == 0) {
-        field_function = get_wm();
-    } else if (strcasecmp(field_name, "resolution") == 0) {
-        field_function = get_resolution();
-    } else if (strcasecmp(field_name, "shell") == 0) {
-        field_function = get_shell();
-    } else if (strcasecmp(field_name, "terminal") == 0) {
-        field_function = get_terminal();
-    } else if (strcasecmp(field_name, "cpu") == 0) {
-        field_function = get_cpu();
-    } else if (strcasecmp(field_name, "memory") == 0) {
-        field_function = get_memory();
-    } else if (strcasecmp(field_name, "user") == 0) {
+    strbuf message = sb_new(BUF_SIZE);
+    // The field value, collected before rendering except for the title and separator
+    // because they depend on the accent color
+    char *field_function = value;
+    const char *field_message = options.messages[kind];
+
+    if (kind == FIELD_USER) {
         field_function = get_title(accent);
         is_user_title = true;
-    } else if (strcasecmp(field_name, "separator") == 0) {
+    } else if (kind == FIELD_SEPARATOR) {
         field_function = get_separator();
         is_separator = true;
-    } else {
-        log_error("Field '%s' doesn't exists", field_name);
-        xfree(field_message);
-        xfree(message);
-        exit(1);
     }
-    snprintf(field_message, BUF_SIZE, "%s_message", str_to_lower((char *)field_name));
-    snprintf(field_message, BUF_SIZE, "%s", get_option_string(field_message));
     if (is_user_title || is_separator) {
-        snprintf(message, BUF_SIZE, "%s%s", "\e[0m", field_function);
+        sb_appendf(&message, "%s%s", "\e[0m", field_function);
     } else {
-        snprintf(message, BUF_SIZE, "%s%s%s %s", field_message, "\e[0m", delimiter, field_function);
+        sb_appendf(&message, "%s%s%s %s", field_message, "\e[0m", delimiter, field_function);
     }
-    xfree(field_message);
 
-    if ((strcasecmp(field_name, "kernel") != 0) && (field_function != NULL)) {
-        xfree(field_function);
+    // Add the field to the frame, without the logo when using minimal mode
+    if (logo_part != NULL) {
+        frame_append(logo_part);
     }
-
-    // Print field information
-    if (logo_part == NULL) {
-        // When using minimal mode (without displaying logo)
-        if (is_user_title) {
-            printf("%s%s%s", gap, accent, message);
-        } else {
-            if (field_function != NULL) {
-                printf("%s%s%s\n", gap, accent, message);
-            } else {
-                printf("%s%s\n", gap, accent);
-            }
-        }
+    frame_append(gap);
+    frame_append(accent);
+    if (is_user_title) {
+        frame_append(message.str);
+    } else if (field_function != NULL) {
+        frame_append(message.str);
+        frame_append("\n");
     } else {
-        if (is_user_title) {
-            printf("%s%s%s%s", logo_part, gap, accent, message);
-        } else {
-            if (field_function != NULL) {
-                printf("%s%s%s%s\n", logo_part, gap, accent, message);
-            } else {
-                printf("%s%s%s\n", logo_part, gap, accent);
-            }
-        }
+        frame_append("\n");
     }
-    xfree(message);
 }
 
 char *get_property(Display *disp, Window win, Atom xa_prop_type, char *prop_name, unsigned long *size) {
@@ -395,9 +438,9 @@ char *get_property(Display *disp, Window win, Atom xa_prop_type, char *prop_name
     unsigned long tmp_size;
     unsigned char *ret_prop;
 
-    xa_prop_name = XInternAtom(disp, prop_name, 0);
+    xa_prop_name = x11.XInternAtom(disp, prop_name, 0);
 
-    if (XGetWindowProperty(disp, win, xa_prop_name, 0, BUF_SIZE, 0, xa_prop_type, &xa_ret_type, &ret_format,
+    if (x11.XGetWindowProperty(disp, win, xa_prop_name, 0, BUF_SIZE, 0, xa_prop_type, &xa_ret_type, &ret_format,
                            &ret_nitems, &ret_bytes_after, &ret_prop) != Success) {
         log_warn("Cannot get %s property.\n", prop_name);
         return NULL;
@@ -405,13 +448,13 @@ char *get_property(Display *disp, Window win, Atom xa_prop_type, char *prop_name
 
     if (xa_ret_type != xa_prop_type) {
         log_warn("Invalid type of %s property.\n", prop_name);
-        XFree(ret_prop);
+        x11.XFree(ret_prop);
         return NULL;
     }
 
     /* null terminate the result to make string handling easier */
     tmp_size = (ret_format / (64 / sizeof(long))) * ret_nitems;
-    char *ret = xmalloc(tmp_size + 1);
+    char *ret = arena_alloc(tmp_size + 1);
     memmove(ret, ret_prop, tmp_size);
     ret[tmp_size] = '\0';
 
@@ -419,6 +462,67 @@ char *get_property(Display *disp, Window win, Atom xa_prop_type, char *prop_name
         *size = tmp_size;
     }
 
-    XFree(ret_prop);
+    x11.XFree(ret_prop);
     return ret;
 }
+
+/**
+ * Get the refresh rate in Hz of an XRandR mode from its timings, 0 if they are unknown
+ */
+int get_mode_refresh_rate(unsigned long dot_clock, unsigned int h_total, unsigned int v_total, bool interlace,
+                          bool double_scan) {
+    double lines = v_total;
+    if (double_scan) {
+        lines *= 2;
+    }
+    if (interlace) {
+        lines /= 2;
+    }
+    if (dot_clock == 0 || h_total == 0 || lines == 0) {
+        return 0;
+    }
+
+    return (int)((double)dot_clock / (h_total * lines) + 0.5);
+}
+
+/**
+ * Format the monitors as "2560x1440 @ 144Hz, 1920x1080 @ 60Hz", the refresh rates are only
+ * shown with the 'display_refresh_rate' option. With the 'group_monitors' option identical
+ * monitors are shown once, e.g. "2x 2560x1440 @ 144Hz"
+ */
+char *format_monitors(const monitor *monitors, int count) {
+    strbuf res = sb_new(BUF_SIZE);
+    bool show_rate = options.display_refresh_rate;
+
+    for (int i = 0; i < count; i++) {
+        int same = 1;
+        if (options.group_monitors) {
+            bool shown = false;
+            for (int j = 0; j < count && !shown; j++) {
+                bool identical = monitors[j].width == monitors[i].width && monitors[j].height == monitors[i].height &&
+                                 (!show_rate || monitors[j].refresh_rate == monitors[i].refresh_rate);
+                if (identical && j < i) {
+                    shown = true;
+                } else if (identical && j > i) {
+                    same++;
+                }
+            }
+            if (shown) {
+                continue;
+            }
+        }
+
+        if (res.len > 0) {
+            sb_append(&res, ", ");
+        }
+        if (same > 1) {
+            sb_appendf(&res, "%dx ", same);
+        }
+        sb_appendf(&res, "%dx%d", monitors[i].width, monitors[i].height);
+        if (show_rate && monitors[i].refresh_rate > 0) {
+            sb_appendf(&res, " @ %dHz", monitors[i].refresh_rate);
+        }
+    }
+
+    return res.str;
+}
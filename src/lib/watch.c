@@ -0,0 +1,350 @@
+/* C stdlib */
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+#include <errno.h>
+#include <libgen.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+/* Custom headers */
+#include "lcfetch.h"
+#include <log.h>
+
+#define MAX_WATCHES 64
+#define INOTIFY_EVENTS (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+// The X display, only if an enabled field queries the X server
+static Display *display = NULL;
+static Atom wm_check = None;
+static int xrandr_event_base = -1;
+static int inotify_fd = -1;
+
+/**
+ * A watched source of a field. Files are watched through their parent directory so they
+ * are still watched after being replaced, e.g. dpkg renames a new status file over the
+ * old one. In that case 'name' is the file name inside the watched directory
+ */
+typedef struct source_watch {
+    int wd;
+    field_kind kind;
+    char *name;
+} source_watch;
+
+static source_watch watches[MAX_WATCHES];
+static int watches_count = 0;
+
+static volatile sig_atomic_t watch_running = true;
+static volatile sig_atomic_t terminal_resized = false;
+
+static void stop_watch(int signum __attribute__((unused))) { watch_running = false; }
+
+static void resize_watch(int signum __attribute__((unused))) { terminal_resized = true; }
+
+/**
+ * Watch the source files and directories of every cacheable field
+ */
+static void add_source_watches(void) {
+    char *paths[MAX_WATCHES];
+    struct stat st;
+
+    for (int kind = 0; kind < FIELD_KINDS; kind++) {
+        int paths_count = get_field_source_paths(kind, paths, MAX_WATCHES);
+        for (int i = 0; i < paths_count; i++) {
+            char *name = NULL;
+            int wd;
+            if (stat(paths[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+                wd = inotify_add_watch(inotify_fd, paths[i], INOTIFY_EVENTS);
+            } else {
+                // dirname and basename can modify their argument
+                char *dir_path = xstrdup(paths[i]);
+                name = xstrdup(basename(paths[i]));
+                wd = inotify_add_watch(inotify_fd, dirname(dir_path), INOTIFY_EVENTS);
+                xfree(dir_path);
+            }
+
+            if (wd != -1 && watches_count < MAX_WATCHES) {
+                watches[watches_count++] = (source_watch){wd, kind, name};
+            } else if (name != NULL) {
+                xfree(name);
+            }
+            xfree(paths[i]);
+        }
+    }
+}
+
+/**
+ * Mark as stale the fields whose sources changed according to the pending inotify events
+ */
+static void read_source_events(bool *stale) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+
+    while ((len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+        for (char *ptr = buf; ptr < buf + len;) {
+            const struct inotify_event *event = (const struct inotify_event *)ptr;
+            for (int i = 0; i < watches_count; i++) {
+                if (watches[i].wd == event->wd &&
+                    (watches[i].name == NULL || (event->len > 0 && strcmp(watches[i].name, event->name) == 0))) {
+                    stale[watches[i].kind] = true;
+                }
+            }
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+/**
+ * Mark as stale the fields that changed according to the pending X events, the window
+ * manager announces itself on the root window and XRandR notifies the screen changes
+ */
+static void read_x_events(bool *stale) {
+    XEvent event;
+
+    while (x11.XPending(display) > 0) {
+        x11.XNextEvent(display, &event);
+        if (event.type == PropertyNotify && event.xproperty.atom == wm_check) {
+            stale[FIELD_WM] = true;
+        } else if (xrandr_event_base != -1 && event.type == xrandr_event_base + RRScreenChangeNotify) {
+            stale[FIELD_RESOLUTION] = true;
+        }
+    }
+}
+
+/**
+ * Start watching the changes of the fields that are not collected on every frame: their
+ * source files (inotify) and the window manager and screen (X events). Returns false if
+ * they can not be watched
+ */
+bool start_change_watch(void) {
+    inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (inotify_fd == -1) {
+        return false;
+    }
+    add_source_watches();
+
+    display = enabled_fields_use_display() ? get_display() : NULL;
+    if (display != NULL) {
+        int xrandr_error_base;
+        wm_check = x11.XInternAtom(display, "_NET_SUPPORTING_WM_CHECK", False);
+        x11.XSelectInput(display, DefaultRootWindow(display), PropertyChangeMask);
+        if (x11.XRRQueryExtension(display, &xrandr_event_base, &xrandr_error_base)) {
+            x11.XRRSelectInput(display, DefaultRootWindow(display), RRScreenChangeNotifyMask);
+        } else {
+            xrandr_event_base = -1;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Fill the descriptors to poll for changes, returns how many of them were filled (at most
+ * MAX_CHANGE_WATCH_FDS). The pending X requests are sent so their events can arrive
+ */
+int get_change_watch_fds(struct pollfd *fds) {
+    int fds_count = 0;
+
+    fds[fds_count++] = (struct pollfd){inotify_fd, POLLIN, 0};
+    if (display != NULL) {
+        x11.XFlush(display);
+        fds[fds_count++] = (struct pollfd){ConnectionNumber(display), POLLIN, 0};
+    }
+
+    return fds_count;
+}
+
+/**
+ * Mark as stale (indexed by field kind) the fields that changed since the last call
+ */
+void read_changes(bool *stale) {
+    read_source_events(stale);
+    if (display != NULL) {
+        read_x_events(stale);
+    }
+}
+
+/**
+ * Stop watching the changes, see start_change_watch
+ */
+void stop_change_watch(void) {
+    for (int i = 0; i < watches_count; i++) {
+        if (watches[i].name != NULL) {
+            xfree(watches[i].name);
+        }
+    }
+    watches_count = 0;
+    close(inotify_fd);
+    inotify_fd = -1;
+}
+
+/**
+ * Render the frame into memory. Returns its rows split in place, the first row holds the
+ * buffer that must be freed
+ */
+static char **render_rows(char *distro_logo, int *rows_count) {
+    int frame_fd = memfd_create("lcfetch-frame", MFD_CLOEXEC);
+    if (frame_fd == -1) {
+        log_error("Unable to create the frame buffer: %s", strerror(errno));
+        exit(1);
+    }
+
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    dup2(frame_fd, STDOUT_FILENO);
+    print_info(distro_logo);
+    flush_frame();
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    off_t frame_size = lseek(frame_fd, 0, SEEK_CUR);
+    char *frame = xmalloc(frame_size + 1);
+    ssize_t nread = pread(frame_fd, frame, frame_size, 0);
+    frame[nread > 0 ? nread : 0] = '\0';
+    close(frame_fd);
+
+    int capacity = 32;
+    char **rows = xmalloc(capacity * sizeof(char *));
+    *rows_count = 0;
+    for (char *row = frame; *row;) {
+        if (*rows_count == capacity) {
+            capacity *= 2;
+            char **bigger_rows = xmalloc(capacity * sizeof(char *));
+            memcpy(bigger_rows, rows, *rows_count * sizeof(char *));
+            xfree(rows);
+            rows = bigger_rows;
+        }
+        rows[(*rows_count)++] = row;
+
+        char *newline = strchr(row, '\n');
+        if (newline == NULL) {
+            break;
+        }
+        *newline = '\0';
+        row = newline + 1;
+    }
+    if (*rows_count == 0) {
+        rows[(*rows_count)++] = frame;
+    }
+
+    return rows;
+}
+
+static void free_rows(char **rows) {
+    xfree(rows[0]);
+    xfree(rows);
+}
+
+/**
+ * Rewrite the rows that changed since the previous frame, or all of them if there is no
+ * previous frame
+ */
+static void update_rows(char **rows, int rows_count, char **previous_rows, int previous_rows_count) {
+    for (int i = 0; i < rows_count; i++) {
+        if (previous_rows == NULL || i >= previous_rows_count || strcmp(rows[i], previous_rows[i]) != 0) {
+            printf("\e[%d;1H\e[0m%s\e[K", i + 1, rows[i]);
+        }
+    }
+    for (int i = rows_count; i < previous_rows_count; i++) {
+        printf("\e[%d;1H\e[0m\e[K", i + 1);
+    }
+    fflush(stdout);
+}
+
+/**
+ * Keep the information on the screen, updating the uptime and memory every second and the
+ * other fields only when they change: when the files they are collected from change
+ * (inotify) or when the X server notifies it. Only the rows that changed are rewritten.
+ * Runs until it gets SIGINT or SIGTERM
+ */
+void run_watch(char *distro_logo) {
+    bool stale[FIELD_KINDS];
+
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (timer_fd == -1 || !start_change_watch()) {
+        log_error("Unable to watch the system information: %s", strerror(errno));
+        exit(1);
+    }
+    struct itimerspec tick = {{1, 0}, {1, 0}};
+    timerfd_settime(timer_fd, 0, &tick, NULL);
+
+    struct sigaction stop_action = {.sa_handler = stop_watch};
+    struct sigaction resize_action = {.sa_handler = resize_watch};
+    sigemptyset(&stop_action.sa_mask);
+    sigemptyset(&resize_action.sa_mask);
+    sigaction(SIGINT, &stop_action, NULL);
+    sigaction(SIGTERM, &stop_action, NULL);
+    sigaction(SIGWINCH, &resize_action, NULL);
+
+    // Collect everything once, the per-client fields included since we are the client
+    for (int kind = 0; kind < FIELD_KINDS; kind++) {
+        stale[kind] = true;
+    }
+    refresh_warm_fields(stale, false);
+
+    // Clear the screen, hide the cursor and disable line wrapping
+    printf("\e[2J\e[H\e[?25l\e[?7l");
+    int rows_count;
+    char **rows = render_rows(distro_logo, &rows_count);
+    update_rows(rows, rows_count, NULL, 0);
+    reset_arena();
+
+    while (watch_running) {
+        struct pollfd fds[1 + MAX_CHANGE_WATCH_FDS] = {{timer_fd, POLLIN, 0}};
+        int fds_count = 1 + get_change_watch_fds(fds + 1);
+        if (poll(fds, fds_count, -1) == -1 && errno != EINTR) {
+            break;
+        }
+
+        memset(stale, 0, sizeof(stale));
+        uint64_t expirations;
+        if (read(timer_fd, &expirations, sizeof(expirations)) > 0) {
+            stale[FIELD_UPTIME] = stale[FIELD_MEMORY] = true;
+        }
+        read_changes(stale);
+
+        bool any_stale = false;
+        for (int kind = 0; kind < FIELD_KINDS; kind++) {
+            any_stale |= stale[kind];
+        }
+        if (!any_stale && !terminal_resized) {
+            continue;
+        }
+        if (any_stale) {
+            // The cache signatures of the WM and the resolution do not change with them, the stale
+            // fields are collected again instead of taken from the cache
+            refresh_warm_fields(stale, true);
+        }
+
+        int new_rows_count;
+        char **new_rows = render_rows(distro_logo, &new_rows_count);
+        if (terminal_resized) {
+            terminal_resized = false;
+            printf("\e[2J");
+            update_rows(new_rows, new_rows_count, NULL, 0);
+        } else {
+            update_rows(new_rows, new_rows_count, rows, rows_count);
+        }
+        free_rows(rows);
+        rows = new_rows;
+        rows_count = new_rows_count;
+        // Everything allocated for the frame is released at once
+        reset_arena();
+    }
+
+    // Leave the cursor below the information and restore the terminal
+    printf("\e[%d;1H\e[0m\e[?25h\e[?7h", rows_count + 1);
+    fflush(stdout);
+    free_rows(rows);
+    free_warm_fields();
+    stop_change_watch();
+    close(timer_fd);
+}
@@ -0,0 +1,289 @@
+/* C stdlib */
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+/* Custom headers */
+#include "lcfetch.h"
+#include <log.h>
+
+// Local X servers listen on X_SOCKET_DIRECTORY/X<display number>, remote ones on TCP port
+// X_TCP_PORT + <display number>
+#define X_SOCKET_DIRECTORY "/tmp/.X11-unix"
+#define X_TCP_PORT 6000
+
+#ifdef MACOS
+#define LIBX11 "libX11.6.dylib"
+#define LIBXRANDR "libXrandr.2.dylib"
+#else
+#define LIBX11 "libX11.so.6"
+#define LIBXRANDR "libXrandr.so.2"
+#endif
+
+#define X11_SYMBOL(library, name) {library, #name, offsetof(x11_library, name)}
+
+// Xlib and XRandR functions, see load_x11_library
+x11_library x11;
+
+static const library_symbol x11_symbols[] = {
+    X11_SYMBOL(LIBX11, XInitThreads),
+    X11_SYMBOL(LIBX11, XOpenDisplay),
+    X11_SYMBOL(LIBX11, XCloseDisplay),
+    X11_SYMBOL(LIBX11, XDefaultScreen),
+    X11_SYMBOL(LIBX11, XInternAtom),
+    X11_SYMBOL(LIBX11, XGetWindowProperty),
+    X11_SYMBOL(LIBX11, XFree),
+    X11_SYMBOL(LIBX11, XSelectInput),
+    X11_SYMBOL(LIBX11, XPending),
+    X11_SYMBOL(LIBX11, XNextEvent),
+    X11_SYMBOL(LIBX11, XFlush),
+    X11_SYMBOL(LIBXRANDR, XRRGetScreenResourcesCurrent),
+    X11_SYMBOL(LIBXRANDR, XRRFreeScreenResources),
+    X11_SYMBOL(LIBXRANDR, XRRGetCrtcInfo),
+    X11_SYMBOL(LIBXRANDR, XRRFreeCrtcInfo),
+    X11_SYMBOL(LIBXRANDR, XRRQueryExtension),
+    X11_SYMBOL(LIBXRANDR, XRRSelectInput),
+};
+
+// The X display, opened by the first field that needs it, see get_display
+static Display *display = NULL;
+static bool display_opened = false;
+static pthread_mutex_t display_lock = PTHREAD_MUTEX_INITIALIZER;
+// The display is opened on its own thread so the whole setup can be given up, see open_display
+static pthread_cond_t display_opening = PTHREAD_COND_INITIALIZER;
+static bool display_opening_finished = false;
+static bool display_opening_abandoned = false;
+
+/**
+ * Load the libraries of the symbols with dlopen and fill the table of function pointers with
+ * them, the libraries are kept loaded. Returns false if any of them is missing
+ */
+bool load_library_symbols(void *table, const library_symbol *symbols, int count) {
+    const char *library = NULL;
+    void *handle = NULL;
+
+    for (int i = 0; i < count; i++) {
+        if (library == NULL || strcmp(library, symbols[i].library) != 0) {
+            library = symbols[i].library;
+            handle = dlopen(library, RTLD_LAZY | RTLD_LOCAL);
+            if (handle == NULL) {
+                log_debug("Unable to load %s: %s", library, dlerror());
+                return false;
+            }
+        }
+        void *symbol = dlsym(handle, symbols[i].name);
+        if (symbol == NULL) {
+            log_debug("Unable to load %s from %s", symbols[i].name, library);
+            return false;
+        }
+        // POSIX guarantees function pointers can be stored as data pointers
+        *(void **)((char *)table + symbols[i].offset) = symbol;
+    }
+
+    return true;
+}
+
+/**
+ * Load the Xlib and XRandR functions, and the XCB ones if it is the X backend
+ */
+static bool load_x11_library(void) {
+    if (!load_library_symbols(&x11, x11_symbols, COUNT(x11_symbols))) {
+        return false;
+    }
+#ifdef USE_XCB
+    return load_xcb_library();
+#else
+    return true;
+#endif
+}
+
+/**
+ * Connect a socket giving up after timeout_ms milliseconds, so a dead server does not
+ * block us for the whole TCP connection timeout
+ */
+static bool connect_with_timeout(int fd, const struct sockaddr *addr, socklen_t addr_len, int timeout_ms) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        return false;
+    }
+    if (connect(fd, addr, addr_len) == 0) {
+        return true;
+    }
+    if (errno != EINPROGRESS) {
+        return false;
+    }
+
+    struct pollfd pfd = {fd, POLLOUT, 0};
+    int ready;
+    do {
+        ready = poll(&pfd, 1, timeout_ms);
+    } while (ready == -1 && errno == EINTR);
+    if (ready <= 0) {
+        return false;
+    }
+
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    return getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_len) == 0 && error == 0;
+}
+
+/**
+ * Check if the X server of the display is listening, waiting at most timeout_ms milliseconds.
+ * The display name format is [protocol/][host]:number[.screen]
+ */
+static bool probe_display(const char *display_name, int timeout_ms) {
+    char host[BUF_SIZE];
+    const char *number = strrchr(display_name, ':');
+    if (number == NULL || (size_t)(number - display_name) >= sizeof(host)) {
+        return false;
+    }
+    snprintf(host, sizeof(host), "%.*s", (int)(number - display_name), display_name);
+    int display_number = atoi(number + 1);
+
+    char *protocol_end = strchr(host, '/');
+    bool is_local = *host == '\0' || strcmp(host, "unix") == 0;
+    const char *host_name = host;
+    if (protocol_end != NULL && *host != '/') {
+        // e.g. unix/:0 or tcp/localhost:10
+        *protocol_end = '\0';
+        is_local = strcmp(host, "unix") == 0 || protocol_end[1] == '\0';
+        host_name = protocol_end + 1;
+    }
+
+    if (is_local || *host_name == '/') {
+        struct sockaddr_un addr = {.sun_family = AF_UNIX};
+        int path_len;
+        if (*host_name == '/') {
+            // Full socket path, e.g. launchd sockets on macOS
+            path_len = snprintf(addr.sun_path, sizeof(addr.sun_path), "%s:%d", host_name, display_number);
+        } else {
+            path_len = snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/X%d", X_SOCKET_DIRECTORY, display_number);
+        }
+        if (path_len >= (int)sizeof(addr.sun_path)) {
+            return false;
+        }
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1) {
+            return false;
+        }
+        bool listening = connect_with_timeout(fd, (struct sockaddr *)&addr, sizeof(addr), timeout_ms);
+        close(fd);
+        return listening;
+    }
+
+    char port[16];
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *addrs;
+    snprintf(port, sizeof(port), "%d", X_TCP_PORT + display_number);
+    if (getaddrinfo(host_name, port, &hints, &addrs) != 0) {
+        return false;
+    }
+    bool listening = false;
+    for (struct addrinfo *addr = addrs; addr != NULL && !listening; addr = addr->ai_next) {
+        int fd = socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC, addr->ai_protocol);
+        if (fd != -1) {
+            listening = connect_with_timeout(fd, addr->ai_addr, addr->ai_addrlen, timeout_ms);
+            close(fd);
+        }
+    }
+    freeaddrinfo(addrs);
+
+    return listening;
+}
+
+/**
+ * Check if the display is forwarded through SSH, sshd listens on localhost:10 and above
+ */
+static bool is_forwarded_display(const char *display_name) {
+    return getenv("SSH_CONNECTION") != NULL && strncmp(display_name, "localhost:", 10) == 0;
+}
+
+/**
+ * Open the display, run on its own thread by get_display. Neither the name resolution nor
+ * the X connection setup can be interrupted, so if get_display stops waiting for them the
+ * thread is left behind and closes the display if it is opened after all
+ */
+static void *open_display(void *display_name) {
+    Display *opened = NULL;
+    if (probe_display(display_name, options.x11_timeout) && load_x11_library()) {
+        // The fields that query the X server are collected at the same time
+        x11.XInitThreads();
+        opened = x11.XOpenDisplay(display_name);
+    }
+
+    pthread_mutex_lock(&display_lock);
+    if (display_opening_abandoned && opened != NULL) {
+        x11.XCloseDisplay(opened);
+    } else {
+        display = opened;
+    }
+    display_opening_finished = true;
+    pthread_cond_signal(&display_opening);
+    pthread_mutex_unlock(&display_lock);
+
+    return NULL;
+}
+
+/**
+ * Get the X display, it is opened the first time a field needs it. Returns NULL if X is
+ * disabled in the options, there is no display, the display is forwarded through SSH (unless
+ * enabled in the options), the X libraries are not installed or the server does not complete
+ * the connection setup before the 'x11_timeout' option, e.g. a dead server or an SSH client
+ * that does not forward it anymore. The X libraries are only loaded at this point
+ */
+Display *get_display(void) {
+    pthread_mutex_lock(&display_lock);
+    if (!display_opened) {
+        display_opened = true;
+        const char *display_name = getenv("DISPLAY");
+        pthread_t opener;
+        if (options.use_x11 && display_name != NULL && *display_name != '\0' &&
+            (options.x11_forwarded || !is_forwarded_display(display_name)) &&
+            pthread_create(&opener, NULL, open_display, (void *)display_name) == 0) {
+            pthread_detach(opener);
+
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += options.x11_timeout / 1000;
+            deadline.tv_nsec += (long)(options.x11_timeout % 1000) * 1000000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            int error = 0;
+            while (!display_opening_finished && error != ETIMEDOUT) {
+                error = pthread_cond_timedwait(&display_opening, &display_lock, &deadline);
+            }
+            if (!display_opening_finished) {
+                display_opening_abandoned = true;
+                log_debug("The X server of %s did not answer in %dms", display_name, options.x11_timeout);
+            }
+        }
+    }
+    pthread_mutex_unlock(&display_lock);
+
+    return display;
+}
+
+/**
+ * Close the X display if it was opened
+ */
+void close_display(void) {
+    pthread_mutex_lock(&display_lock);
+    if (display != NULL) {
+        x11.XCloseDisplay(display);
+        display = NULL;
+    }
+    pthread_mutex_unlock(&display_lock);
+}
@@ -0,0 +1,323 @@
+/* C stdlib */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* Custom headers */
+#include "lcfetch.h"
+#include <log.h>
+
+#ifdef USE_XCB
+/* X headers */
+#include <X11/Xlib-xcb.h>
+#include <xcb/randr.h>
+#include <xcb/xcb.h>
+
+#ifdef MACOS
+#define LIBX11_XCB "libX11-xcb.1.dylib"
+#define LIBXCB "libxcb.1.dylib"
+#define LIBXCB_RANDR "libxcb-randr.0.dylib"
+#else
+#define LIBX11_XCB "libX11-xcb.so.1"
+#define LIBXCB "libxcb.so.1"
+#define LIBXCB_RANDR "libxcb-randr.so.0"
+#endif
+
+/**
+ * XCB functions, loaded with the X libraries when the display is opened
+ */
+static struct xcb_library {
+    xcb_connection_t *(*XGetXCBConnection)(Display *display);
+    const xcb_setup_t *(*xcb_get_setup)(xcb_connection_t *c);
+    xcb_screen_iterator_t (*xcb_setup_roots_iterator)(const xcb_setup_t *r);
+    void (*xcb_screen_next)(xcb_screen_iterator_t *i);
+    xcb_intern_atom_cookie_t (*xcb_intern_atom)(xcb_connection_t *c, uint8_t only_if_exists, uint16_t name_len,
+                                                const char *name);
+    xcb_intern_atom_reply_t *(*xcb_intern_atom_reply)(xcb_connection_t *c, xcb_intern_atom_cookie_t cookie,
+                                                      xcb_generic_error_t **e);
+    xcb_get_property_cookie_t (*xcb_get_property)(xcb_connection_t *c, uint8_t _delete, xcb_window_t window,
+                                                  xcb_atom_t property, xcb_atom_t type, uint32_t long_offset,
+                                                  uint32_t long_length);
+    xcb_get_property_reply_t *(*xcb_get_property_reply)(xcb_connection_t *c, xcb_get_property_cookie_t cookie,
+                                                        xcb_generic_error_t **e);
+    void *(*xcb_get_property_value)(const xcb_get_property_reply_t *R);
+    int (*xcb_get_property_value_length)(const xcb_get_property_reply_t *R);
+    xcb_randr_get_screen_resources_current_cookie_t (*xcb_randr_get_screen_resources_current)(xcb_connection_t *c,
+                                                                                              xcb_window_t window);
+    xcb_randr_get_screen_resources_current_reply_t *(*xcb_randr_get_screen_resources_current_reply)(
+        xcb_connection_t *c, xcb_randr_get_screen_resources_current_cookie_t cookie, xcb_generic_error_t **e);
+    xcb_randr_crtc_t *(*xcb_randr_get_screen_resources_current_crtcs)(
+        const xcb_randr_get_screen_resources_current_reply_t *R);
+    int (*xcb_randr_get_screen_resources_current_crtcs_length)(const xcb_randr_get_screen_resources_current_reply_t *R);
+    xcb_randr_mode_info_t *(*xcb_randr_get_screen_resources_current_modes)(
+        const xcb_randr_get_screen_resources_current_reply_t *R);
+    int (*xcb_randr_get_screen_resources_current_modes_length)(const xcb_randr_get_screen_resources_current_reply_t *R);
+    xcb_randr_get_crtc_info_cookie_t (*xcb_randr_get_crtc_info)(xcb_connection_t *c, xcb_randr_crtc_t crtc,
+                                                                xcb_timestamp_t config_timestamp);
+    xcb_randr_get_crtc_info_reply_t *(*xcb_randr_get_crtc_info_reply)(xcb_connection_t *c,
+                                                                      xcb_randr_get_crtc_info_cookie_t cookie,
+                                                                      xcb_generic_error_t **e);
+} xcb;
+
+#define XCB_SYMBOL(library, name) {library, #name, offsetof(struct xcb_library, name)}
+
+static const library_symbol xcb_symbols[] = {
+    XCB_SYMBOL(LIBX11_XCB, XGetXCBConnection),
+    XCB_SYMBOL(LIBXCB, xcb_get_setup),
+    XCB_SYMBOL(LIBXCB, xcb_setup_roots_iterator),
+    XCB_SYMBOL(LIBXCB, xcb_screen_next),
+    XCB_SYMBOL(LIBXCB, xcb_intern_atom),
+    XCB_SYMBOL(LIBXCB, xcb_intern_atom_reply),
+    XCB_SYMBOL(LIBXCB, xcb_get_property),
+    XCB_SYMBOL(LIBXCB, xcb_get_property_reply),
+    XCB_SYMBOL(LIBXCB, xcb_get_property_value),
+    XCB_SYMBOL(LIBXCB, xcb_get_property_value_length),
+    XCB_SYMBOL(LIBXCB_RANDR, xcb_randr_get_screen_resources_current),
+    XCB_SYMBOL(LIBXCB_RANDR, xcb_randr_get_screen_resources_current_reply),
+    XCB_SYMBOL(LIBXCB_RANDR, xcb_randr_get_screen_resources_current_crtcs),
+    XCB_SYMBOL(LIBXCB_RANDR, xcb_randr_get_screen_resources_current_crtcs_length),
+    XCB_SYMBOL(LIBXCB_RANDR, xcb_randr_get_screen_resources_current_modes),
+    XCB_SYMBOL(LIBXCB_RANDR, xcb_randr_get_screen_resources_current_modes_length),
+    XCB_SYMBOL(LIBXCB_RANDR, xcb_randr_get_crtc_info),
+    XCB_SYMBOL(LIBXCB_RANDR, xcb_randr_get_crtc_info_reply),
+};
+
+/**
+ * Load the XCB functions, see get_display
+ */
+bool load_xcb_library(void) { return load_library_symbols(&xcb, xcb_symbols, COUNT(xcb_symbols)); }
+
+/**
+ * Atoms used by the X fields, they are interned all at once the first time and kept
+ * for the next queries
+ */
+enum {
+    ATOM_NET_SUPPORTING_WM_CHECK,
+    ATOM_WIN_SUPPORTING_WM_CHECK,
+    ATOM_NET_WM_NAME,
+    ATOM_UTF8_STRING,
+    ATOM_NET_ACTIVE_WINDOW,
+    ATOMS_COUNT,
+};
+
+static const char *atom_names[ATOMS_COUNT] = {
+    [ATOM_NET_SUPPORTING_WM_CHECK] = "_NET_SUPPORTING_WM_CHECK",
+    [ATOM_WIN_SUPPORTING_WM_CHECK] = "_WIN_SUPPORTING_WM_CHECK",
+    [ATOM_NET_WM_NAME] = "_NET_WM_NAME",
+    [ATOM_UTF8_STRING] = "UTF8_STRING",
+    [ATOM_NET_ACTIVE_WINDOW] = "_NET_ACTIVE_WINDOW",
+};
+
+static xcb_atom_t atoms[ATOMS_COUNT];
+static bool atoms_interned = false;
+static pthread_mutex_t atoms_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Send every intern request before waiting for the first reply, so interning all the
+ * atoms costs a single round trip
+ */
+static void intern_atoms(xcb_connection_t *conn) {
+    pthread_mutex_lock(&atoms_lock);
+    if (!atoms_interned) {
+        xcb_intern_atom_cookie_t cookies[ATOMS_COUNT];
+        for (int i = 0; i < ATOMS_COUNT; i++) {
+            cookies[i] = xcb.xcb_intern_atom(conn, 1, strlen(atom_names[i]), atom_names[i]);
+        }
+        for (int i = 0; i < ATOMS_COUNT; i++) {
+            xcb_intern_atom_reply_t *reply = xcb.xcb_intern_atom_reply(conn, cookies[i], NULL);
+            atoms[i] = reply != NULL ? reply->atom : XCB_ATOM_NONE;
+            free(reply);
+        }
+        atoms_interned = true;
+    }
+    pthread_mutex_unlock(&atoms_lock);
+}
+
+/**
+ * Get the default screen of the display
+ */
+static xcb_screen_t *get_screen(Display *display, xcb_connection_t *conn) {
+    xcb_screen_iterator_t screens = xcb.xcb_setup_roots_iterator(xcb.xcb_get_setup(conn));
+    for (int i = 0; i < DefaultScreen(display) && screens.rem > 1; i++) {
+        xcb.xcb_screen_next(&screens);
+    }
+    return screens.data;
+}
+
+/**
+ * Request a property, an atom that does not exist is never requested
+ */
+static xcb_get_property_cookie_t request_property(xcb_connection_t *conn, xcb_window_t win, xcb_atom_t property,
+                                                  xcb_atom_t type) {
+    xcb_get_property_cookie_t cookie = {0};
+    if (win != XCB_NONE && property != XCB_ATOM_NONE) {
+        cookie = xcb.xcb_get_property(conn, 0, win, property, type, 0, BUF_SIZE);
+    }
+    return cookie;
+}
+
+/**
+ * Wait for a property reply. Returns NULL if it was not requested, failed, is empty or
+ * does not have the expected type (XCB_ATOM_ANY for any type)
+ */
+static xcb_get_property_reply_t *get_property_reply(xcb_connection_t *conn, xcb_get_property_cookie_t cookie,
+                                                    xcb_atom_t type) {
+    if (cookie.sequence == 0) {
+        return NULL;
+    }
+
+    xcb_generic_error_t *error = NULL;
+    xcb_get_property_reply_t *reply = xcb.xcb_get_property_reply(conn, cookie, &error);
+    free(error);
+    if (reply != NULL &&
+        (xcb.xcb_get_property_value_length(reply) == 0 || (type != XCB_ATOM_ANY && reply->type != type))) {
+        free(reply);
+        return NULL;
+    }
+    return reply;
+}
+
+/**
+ * Get a window from a property reply
+ */
+static xcb_window_t get_window_reply(xcb_connection_t *conn, xcb_get_property_cookie_t cookie, xcb_atom_t type) {
+    xcb_get_property_reply_t *reply = get_property_reply(conn, cookie, type);
+    xcb_window_t win = XCB_NONE;
+    if (reply != NULL && reply->format == 32) {
+        win = *(xcb_window_t *)xcb.xcb_get_property_value(reply);
+    }
+    free(reply);
+    return win;
+}
+
+/**
+ * Get a string from a property reply, allocated in the arena
+ */
+static char *get_string_reply(xcb_connection_t *conn, xcb_get_property_cookie_t cookie, xcb_atom_t type) {
+    xcb_get_property_reply_t *reply = get_property_reply(conn, cookie, type);
+    if (reply == NULL) {
+        return NULL;
+    }
+
+    int len = xcb.xcb_get_property_value_length(reply);
+    char *str = arena_alloc(len + 1);
+    memcpy(str, xcb.xcb_get_property_value(reply), len);
+    str[len] = '\0';
+    free(reply);
+
+    return str;
+}
+
+/**
+ * Get the window manager name, the properties that do not depend on each other are requested
+ * at the same time so it costs two round trips
+ */
+char *get_xcb_wm(Display *display) {
+    xcb_connection_t *conn = xcb.XGetXCBConnection(display);
+    xcb_window_t root = get_screen(display, conn)->root;
+    intern_atoms(conn);
+
+    xcb_get_property_cookie_t net_check =
+        request_property(conn, root, atoms[ATOM_NET_SUPPORTING_WM_CHECK], XCB_ATOM_WINDOW);
+    xcb_get_property_cookie_t win_check =
+        request_property(conn, root, atoms[ATOM_WIN_SUPPORTING_WM_CHECK], XCB_ATOM_CARDINAL);
+    xcb_window_t top_win = get_window_reply(conn, net_check, XCB_ATOM_WINDOW);
+    xcb_window_t legacy_top_win = get_window_reply(conn, win_check, XCB_ATOM_CARDINAL);
+    if (top_win == XCB_NONE) {
+        top_win = legacy_top_win;
+    }
+    if (top_win == XCB_NONE) {
+        log_debug("Cannot get window manager required properties."
+                  "(_NET_SUPPORTING_WM_CHECK or _WIN_SUPPORTING_WM_CHECK)\n");
+        return arena_strdup("lcfetch was not able to recognize your window manager");
+    }
+
+    xcb_get_property_cookie_t utf8_name =
+        request_property(conn, top_win, atoms[ATOM_NET_WM_NAME], atoms[ATOM_UTF8_STRING]);
+    xcb_get_property_cookie_t name = request_property(conn, top_win, atoms[ATOM_NET_WM_NAME], XCB_ATOM_STRING);
+    char *wm_name = get_string_reply(conn, utf8_name, atoms[ATOM_UTF8_STRING]);
+    char *legacy_wm_name = get_string_reply(conn, name, XCB_ATOM_STRING);
+    if (wm_name == NULL) {
+        wm_name = legacy_wm_name;
+    }
+    if (wm_name == NULL) {
+        log_debug("Cannot get name of the window manager (_NET_WM_NAME).\n");
+        return arena_strdup("lcfetch was not able to recognize your window manager");
+    }
+
+    return wm_name;
+}
+
+/**
+ * Get the class of the active window, i.e. the terminal lcfetch runs in
+ */
+char *get_xcb_terminal(Display *display) {
+    xcb_connection_t *conn = xcb.XGetXCBConnection(display);
+    xcb_window_t root = get_screen(display, conn)->root;
+    intern_atoms(conn);
+
+    xcb_get_property_cookie_t active_win = request_property(conn, root, atoms[ATOM_NET_ACTIVE_WINDOW], XCB_ATOM_ANY);
+    xcb_window_t win = get_window_reply(conn, active_win, XCB_ATOM_ANY);
+    // WM_CLASS is the instance name followed by the class name, the first one is used
+    return get_string_reply(conn, request_property(conn, win, XCB_ATOM_WM_CLASS, XCB_ATOM_ANY), XCB_ATOM_ANY);
+}
+
+/**
+ * Get the resolution and refresh rate of every monitor from the screen resources cached by the
+ * server, the information of all the CRTCs is requested before waiting for any of them
+ */
+char *get_xcb_resolution(Display *display) {
+    xcb_connection_t *conn = xcb.XGetXCBConnection(display);
+    xcb_screen_t *screen = get_screen(display, conn);
+    xcb_generic_error_t *error = NULL;
+
+    xcb_randr_get_screen_resources_current_reply_t *resources = xcb.xcb_randr_get_screen_resources_current_reply(
+        conn, xcb.xcb_randr_get_screen_resources_current(conn, screen->root), &error);
+    free(error);
+    int crtcs_count = resources != NULL ? xcb.xcb_randr_get_screen_resources_current_crtcs_length(resources) : 0;
+    monitor *monitors = arena_alloc((crtcs_count + 1) * sizeof(monitor));
+    int monitors_count = 0;
+
+    if (crtcs_count > 0) {
+        xcb_randr_crtc_t *crtcs = xcb.xcb_randr_get_screen_resources_current_crtcs(resources);
+        xcb_randr_mode_info_t *modes = xcb.xcb_randr_get_screen_resources_current_modes(resources);
+        int modes_count = xcb.xcb_randr_get_screen_resources_current_modes_length(resources);
+        xcb_randr_get_crtc_info_cookie_t *cookies = xmalloc(crtcs_count * sizeof(xcb_randr_get_crtc_info_cookie_t));
+        for (int i = 0; i < crtcs_count; i++) {
+            cookies[i] = xcb.xcb_randr_get_crtc_info(conn, crtcs[i], resources->config_timestamp);
+        }
+
+        for (int i = 0; i < crtcs_count; i++) {
+            error = NULL;
+            xcb_randr_get_crtc_info_reply_t *crtc = xcb.xcb_randr_get_crtc_info_reply(conn, cookies[i], &error);
+            free(error);
+            // Disabled CRTCs have no mode nor outputs
+            if (crtc != NULL && crtc->mode != XCB_NONE && crtc->num_outputs > 0) {
+                monitor *mon = &monitors[monitors_count++];
+                *mon = (monitor){crtc->width, crtc->height, 0};
+                for (int j = 0; j < modes_count; j++) {
+                    if (modes[j].id == crtc->mode) {
+                        mon->refresh_rate = get_mode_refresh_rate(
+                            modes[j].dot_clock, modes[j].htotal, modes[j].vtotal,
+                            modes[j].mode_flags & XCB_RANDR_MODE_FLAG_INTERLACE,
+                            modes[j].mode_flags & XCB_RANDR_MODE_FLAG_DOUBLE_SCAN);
+                        break;
+                    }
+                }
+            }
+            free(crtc);
+        }
+        xfree(cookies);
+    }
+    free(resources);
+
+    // Without XRandR or active CRTCs, e.g. Xvfb, fallback to the screen size
+    if (monitors_count == 0) {
+        monitors[monitors_count++] = (monitor){screen->width_in_pixels, screen->height_in_pixels, 0};
+    }
+
+    return format_monitors(monitors, monitors_count);
+}
+#endif
@@ -25,12 +25,35 @@ if is_mode("release") then
 end
 
 -- preprocessor variables
+-- expose POSIX and GNU extensions (getline, popen, mmap, ...) while building as C99
+add_defines("_GNU_SOURCE")
 if is_plat("macosx") then
   add_defines("MACOS")
 end
 
+-- build options
+-- read the startup files in a single io_uring batch, 'xmake f --io_uring=y' (Linux >= 5.6)
+option("io_uring")
+  set_default(false)
+  set_showmenu(true)
+  set_description("Read the startup files with io_uring")
+  add_defines("USE_IO_URING")
+option_end()
+-- query the X server through XCB, pipelining the requests, 'xmake f --xcb=y'
+option("xcb")
+  set_default(false)
+  set_showmenu(true)
+  set_description("Query the X server with pipelined XCB requests instead of Xlib")
+  add_defines("USE_XCB")
+option_end()
+
 -- third-party dependencies
-add_requires("lua >= 5.3.6", "libx11", "libxrandr", "xorgproto", "log.c")
+-- libX11 and libXrandr (and libxcb with the 'xcb' option) are loaded with dlopen when the display
+-- is needed, they are only required for their headers and never linked
+add_requires("lua >= 5.3.6", "libx11", "libxrandr", "xorgproto", "sqlite3", "zlib", "log.c")
+if has_config("xcb") then
+  add_requires("libxcb")
+end
 
 -- headers directories
 add_includedirs("src/include")
@@ -77,11 +100,15 @@ target("lcfetch")
   add_files("src/*.c", "src/lib/*.c")
 
   -- Add third-party dependencies
-  add_packages("lua", "libx11", "libxrandr", "xorgproto", "log.c")
-
-  -- Add MacOS dynamic libraries that doesn't follow the 'libfoo.*' pattern
-  if is_plat("macosx") then
-    add_links("libXrandr.2.dylib")
+  add_packages("lua", "xorgproto", "sqlite3", "zlib", "log.c")
+  -- Only the include directories of the X libraries, they are loaded with dlopen
+  add_packages("libx11", "libxrandr", { links = {} })
+  -- pthread: package managers are scanned in parallel, dl: the X libraries are loaded with dlopen
+  add_syslinks("pthread", "dl")
+  add_options("io_uring", "xcb")
+  if has_config("xcb") then
+    -- libX11-xcb (Xlib-xcb.h) shares the Xlib connection with XCB
+    add_packages("libxcb", { links = {} })
   end
 
   -- Precompile main lcfetch header to optimize compile time